@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "benchmarks.hpp"
+#include "calculator.hpp"
+#include "numeric.hpp"
+#include "compiled.hpp"
+#include "taskpool.hpp"
+
+//The factorial loop that tableFactorial replaced
+double loopFactorial(double n){
+    double ret = n;
+    while (n > 1){
+        n -= 1;
+        ret *= n;
+    }
+    return ret;
+}
+
+//The three factorial choose that binomial replaced
+double factorialChoose(double a, double b){
+    return loopFactorial(a)/(loopFactorial(b) * loopFactorial(a-b));
+}
+
+void benchmark_numericKernels(){
+    const long long iterations = 2000000;
+    std::cout << "factorial, n = 0 ... 170\n";
+    benchmark("  loop", iterations, [](long long i){ return loopFactorial(double(i%171)); });
+    benchmark("  table", iterations, [](long long i){ return tableFactorial(double(i%171)); });
+    std::cout << "choose, n = 100 ... 170, k = n/3\n";
+    benchmark("  factorials", iterations, [](long long i){ double n = 100+i%71; return factorialChoose(n, std::floor(n/3)); });
+    benchmark("  binomial", iterations, [](long long i){ double n = 100+i%71; return binomial(n, std::floor(n/3)); });
+    std::cout << "choose(1000, 500): factorials " << factorialChoose(1000, 500) << ", binomial " << binomial(1000.0, 500.0) << "\n";
+    std::vector<double> bases(1024);
+    for (size_t i = 0; i < bases.size(); ++i)
+        bases[i] = 0.5+i/512.0;
+    for (double exponent : {2.0, 3.0, 7.0, -2.0, 0.5, 1.5, 2.7}){
+        std::cout << "x^" << exponent << "\n";
+        benchmark("  std::pow", iterations, [&](long long i){ return std::pow(bases[i%1024], exponent); });
+        benchmark("  fastPow", iterations, [&](long long i){ return fastPow(bases[i%1024], exponent); });
+    }
+}
+
+//One element at a time, with fmin and fmax, as a baseline for the SIMD reductions
+template<typename Number>
+Number scalarSum(const BasicArray<Number>& values){
+    Number total = 0;
+    for (Number value : values)
+        total += value;
+    return total;
+}
+
+template<typename Number>
+Number scalarMin(const BasicArray<Number>& values){
+    Number result = values[0];
+    for (Number value : values)
+        result = std::fmin(result, value);
+    return result;
+}
+
+template<typename Number>
+Number scalarDot(const BasicArray<Number>& a, const BasicArray<Number>& b){
+    Number total = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        total += a[i]*b[i];
+    return total;
+}
+
+template<typename Number>
+void benchmarkReductions(const std::string& name){
+    const size_t size = 1000000;
+    const long long iterations = 50;
+    BasicArray<Number> xs(size), ys(size);
+    for (size_t i = 0; i < size; ++i){
+        xs[i] = Number(i%1000)/1000;
+        ys[i] = Number(i%997)/997;
+    }
+    std::cout << name << ", 1M values\n";
+    auto perValue = [&](const std::string& label, auto code){
+        double nanoseconds = benchmark(label, iterations, code);
+        std::cout << "    " << nanoseconds/size << " ns/value\n";
+    };
+    perValue("  sum, scalar", [&](long long){ return double(scalarSum(xs)); });
+    perValue("  sum, lanes", [&](long long){ return double(defaultFunction_sum(xs)); });
+    perValue("  min, scalar", [&](long long){ return double(scalarMin(xs)); });
+    perValue("  min, lanes", [&](long long){ return double(defaultFunction_arrayMin(xs)); });
+    perValue("  dot, scalar", [&](long long){ return double(scalarDot(xs, ys)); });
+    perValue("  dot, lanes", [&](long long){ return double(defaultFunction_dot(xs, ys)); });
+}
+
+void benchmark_reductions(){
+    benchmarkReductions<float>("float");
+    benchmarkReductions<double>("double");
+    benchmarkReductions<long double>("long double");
+}
+
+//Times one batch scoring expression over an array and one scalar loop with every value held as a Number,
+//returns both results so their accuracy can be compared against long double
+template<typename Number>
+std::pair<long double, long double> benchmarkNumberType(const std::string& name){
+    const size_t batchSize = 1000000;
+    std::map<std::string, Number> variables;
+    std::map<std::string, BasicArray<Number>> arrays;
+    std::map<std::string, Function> functions;
+    BasicArray<Number> xs(batchSize);
+    for (size_t i = 0; i < batchSize; ++i)
+        xs[i] = Number(i%1000)/1000;
+    arrays["xs"] = xs;
+    std::cout << name << "\n";
+    long double batchResult = 0;
+    double nanoseconds = benchmark("  batch, sum(xs*xs*0.25 + xs*0.5 - 1) over 1M values", 20, [&](long long){
+        batchResult = evaluateExpression("sum(xs*xs*0.25 + xs*0.5 - 1)", variables, arrays, functions).scalar;
+        return double(batchResult);
+    });
+    std::cout << "    " << nanoseconds/batchSize << " ns/value\n";
+    long double loopResult = 0;
+    benchmark("  loop, sum(k, 1, 100000, 1/k^2)", 5, [&](long long){
+        loopResult = evaluateExpression("sum(k, 1, 100000, 1/k^2)", variables, arrays, functions).scalar;
+        return double(loopResult);
+    });
+    return {batchResult, loopResult};
+}
+
+void benchmark_numberTypes(){
+    std::pair<long double, long double> floatResults = benchmarkNumberType<float>("float");
+    std::pair<long double, long double> doubleResults = benchmarkNumberType<double>("double");
+    std::pair<long double, long double> longDoubleResults = benchmarkNumberType<long double>("long double");
+    std::cout << "relative error against long double\n";
+    std::cout << "  float: batch " << std::fabs(floatResults.first/longDoubleResults.first-1) << ", loop " << std::fabs(floatResults.second/longDoubleResults.second-1) << "\n";
+    std::cout << "  double: batch " << std::fabs(doubleResults.first/longDoubleResults.first-1) << ", loop " << std::fabs(doubleResults.second/longDoubleResults.second-1) << "\n";
+}
+
+static constexpr auto compiledScore = compileExpression("x*x*0.25 + x*0.5 - 1");
+
+void benchmark_compiled(){
+    const long long iterations = 2000000;
+    std::map<std::string, double> variables;
+    std::map<std::string, Function> functions;
+    std::vector<Token> postfix = convertToPostfix(tokenize("x*x*0.25 + x*0.5 - 1"), functions);
+    std::cout << "x*x*0.25 + x*0.5 - 1\n";
+    benchmark("  runtime", iterations/10, [&](long long i){
+        variables["x"] = (i%1000)/1000.0;
+        return evaluateExpression(postfix, variables, functions);
+    });
+    benchmark("  compiled, interpreted", iterations, [](long long i){ double x = (i%1000)/1000.0; return compiledScore.evaluate(&x); });
+    benchmark("  compiled, expanded", iterations, [](long long i){ return evaluateCompiled<compiledScore>((i%1000)/1000.0); });
+    benchmark("  hand written", iterations, [](long long i){ double x = (i%1000)/1000.0; return x*x*0.25 + x*0.5 - 1; });
+}
+
+void benchmark_parallelExpressions(){
+    std::map<std::string, double> variables{{"x", 0.37}};
+    std::map<std::string, Array> arrays;
+    std::map<std::string, Function> functions;
+    std::string expression;
+    for (int i = 0; i < 1000000; ++i)
+        expression += (i? " + " : "")+std::string("sin(x*")+std::to_string(i%97)+")/3";
+    std::vector<Token> postfix = convertToPostfix(tokenize(expression), functions);
+    std::cout << "sum of 1M terms, " << postfix.size() << " tokens\n";
+    for (unsigned threads : {1u, 2u, std::max(2u, std::thread::hardware_concurrency())}){
+        TaskPool pool(threads);
+        EvaluationOptions options;
+        options.expressionPool = &pool;
+        benchmark("  "+std::to_string(threads)+" thread(s)", 3, [&](long long){ return evaluateExpression(postfix, variables, arrays, functions, options).scalar; });
+    }
+}
+
+//Prints the 50th, 90th and 99th percentiles and the maximum of samples in milliseconds
+void printPercentiles(const std::string& name, std::vector<double> samples){
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double fraction){ return samples[std::min(samples.size()-1, size_t(fraction*samples.size()))]; };
+    std::cout << name << ": p50 " << at(0.5) << " ms, p90 " << at(0.9) << " ms, p99 " << at(0.99) << " ms, max " << samples.back() << " ms\n";
+}
+
+void benchmark_budgets(){
+    using Clock = std::chrono::steady_clock;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    const int runs = 50;
+    std::map<std::string, double> variables;
+    std::map<std::string, Array> arrays;
+    std::map<std::string, Function> functions;
+    const std::string adversarial = "sum(i, 1, 1000000000000, sum(j, 1, 10, i*j))";
+    std::cout << "stopping " << adversarial << ", " << runs << " runs\n";
+    for (unsigned threads : {1u, std::max(2u, std::thread::hardware_concurrency())}){
+        // how long after the deadline the time limit error reaches the caller
+        EvaluationOptions timeLimited;
+        timeLimited.maxTime = std::chrono::milliseconds(20);
+        timeLimited.loopThreads = threads;
+        timeLimited.loopChunkSize = 1000;
+        std::vector<double> overruns;
+        for (int run = 0; run < runs; ++run){
+            Clock::time_point start = Clock::now();
+            try{
+                evaluateExpression(adversarial, variables, arrays, functions, timeLimited);
+            }
+            catch (const EvaluationLimitError&){}
+            overruns.push_back(Milliseconds(Clock::now()-start-timeLimited.maxTime).count());
+        }
+        printPercentiles("  "+std::to_string(threads)+" thread(s), overrun past a 20ms time limit", overruns);
+        // how long after cancel() the cancellation error reaches the caller
+        EvaluationOptions cancellable = timeLimited;
+        cancellable.maxTime = std::chrono::milliseconds(0);
+        std::vector<double> latencies;
+        for (int run = 0; run < runs; ++run){
+            CancellationToken cancellation;
+            cancellable.cancellation = &cancellation;
+            Clock::time_point cancelled;
+            std::thread controller([&](){
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                cancelled = Clock::now();
+                cancellation.cancel();
+            });
+            try{
+                evaluateExpression(adversarial, variables, arrays, functions, cancellable);
+            }
+            catch (const EvaluationLimitError&){}
+            Clock::time_point stopped = Clock::now();
+            controller.join();
+            latencies.push_back(Milliseconds(stopped-cancelled).count());
+        }
+        printPercentiles("  "+std::to_string(threads)+" thread(s), cancellation latency", latencies);
+    }
+    // the same loop with no limits and with every limit set far beyond what it needs
+    std::vector<Token> postfix = convertToPostfix(tokenize("sum(i, 1, 1000000, i)"), functions);
+    EvaluationOptions unlimited;
+    unlimited.maxCallDepth = 0;
+    CancellationToken cancellation;
+    EvaluationOptions limited;
+    limited.maxSteps = 1000000000000;
+    limited.maxTime = std::chrono::hours(1);
+    limited.cancellation = &cancellation;
+    std::cout << "sum(i, 1, 1000000, i), budget checks\n";
+    double withoutLimits = benchmark("  no limits", 5, [&](long long){ return evaluateExpression(postfix, variables, arrays, functions, unlimited).scalar; });
+    double withLimits = benchmark("  step, time, depth and cancellation limits", 5, [&](long long){ return evaluateExpression(postfix, variables, arrays, functions, limited).scalar; });
+    std::cout << "    " << (withLimits-withoutLimits)/1000000 << " ns/iteration for the checks\n";
+}
+
+void runAllBenchmarks(){
+    benchmark_numericKernels();
+    benchmark_reductions();
+    benchmark_numberTypes();
+    benchmark_compiled();
+    benchmark_parallelExpressions();
+    benchmark_budgets();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <chrono>
+#include <iostream>
+#include <string>
+
+//Calls code(i) for i in [0, iterations) and prints the average time per call,
+//code returns a double that is accumulated so the work cannot be optimized away
+template<typename Callable>
+double benchmark(const std::string& name, long long iterations, Callable code){
+    double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < iterations; ++i)
+        sink += code(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now()-start;
+    std::cout << name << ": " << elapsed.count()/iterations << " ns/call (checksum " << sink << ")\n";
+    return elapsed.count()/iterations;
+}
+
+void benchmark_numericKernels();
+
+void benchmark_reductions();
+
+void benchmark_numberTypes();
+
+void benchmark_compiled();
+
+void benchmark_parallelExpressions();
+
+void benchmark_budgets();
+
+void runAllBenchmarks();
@@ -1,54 +1,41 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <climits>
 #include <cmath>
+#include <cstring>
 #include <stack>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 
 #include "calculator.hpp"
+#include "numeric.hpp"
+#include "taskpool.hpp"
 
 int getPrecedence(const Token& op){
     assert (op.type == TokenType::Operator);
-    const static std::map<std::string, int> s_precedence{
-        {"?", 0},
-        {":", 1},
-        {"<", 2}, {">", 2}, {"<=", 2}, {">=", 2}, {"==", 2}, {"&&", 2}, {"||", 2},
-        {"+", 3}, {"-", 3},
-        {"*", 4}, {"/", 4}, {"%", 4},
-        {"^", 5},
-    };
-    auto it = s_precedence.find(op.token);
-    if (it == s_precedence.end())
+    int precedence = precedenceOf(op.token);
+    if (precedence < 0)
         throw Error{std::string("[Error]: Unrecognized operator (")+op.token+")"};
-    return it->second;
-}
-
-bool isDigit(char c){
-    return ((c-'0') >= 0 && (c-'0') <= 9) || c == '.';
-}
-
-bool isOperator(char c){
-    return c == '%' || c == '+' || c == '-' || c == '*' || c == '/' || c == '^' || c == '<' || c == '>' || c == '=' || c == '&' || c == '|' || c == '?' || c == ':' || c == ',';
-}
-
-bool isIdentifier(char c){
-    return ((c-'a') <= ('z'-'a') && (c-'a') >= 0) || ((c-'A') <= ('Z'-'A') && (c-'A') >= 0) || c == '_';
+    return precedence;
 }
 
-double factorial(double n){
+template<typename Number>
+Number factorial(Number n){
     if (n != std::floor(n))
         throw Error{"[Error]: Cannot calculate factorial of non integer"};
     else if (n < 0)
         throw Error{"[Error]: Cannot calculate factorial of negative number"};
-    double ret = n;
-    while (n > 1){
-        n -= 1;
-        ret *= n;
-    }
-    return ret;
+    return tableFactorial(n);
 }
 
-typedef double (*FUNCTION_POINTER_ARG1)(double);
-const std::map<std::string, FUNCTION_POINTER_ARG1> defaultFunctions_arg1{
+template<typename Number>
+using FUNCTION_POINTER_ARG1 = Number (*)(Number);
+template<typename Number>
+const std::map<std::string, FUNCTION_POINTER_ARG1<Number>> defaultFunctions_arg1{
     {"sin", std::sin},
     {"cos", std::cos},
     {"tan", std::tan},
@@ -57,33 +44,415 @@ const std::map<std::string, FUNCTION_POINTER_ARG1> defaultFunctions_arg1{
     {"cbrt", std::cbrt},
     {"floor", std::floor},
     {"ceil", std::ceil},
-    {"factorial", factorial},
+    {"factorial", factorial<Number>},
 };
 
-double defaultFunction_choose(double a, double b){
-    return factorial(a)/(factorial(b) * factorial(a-b));
+template<typename Number>
+Number defaultFunction_choose(Number a, Number b){
+    if (a != std::floor(a) || b != std::floor(b))
+        throw Error{"[Error]: Cannot calculate choose of non integer"};
+    else if (a < 0 || b < 0)
+        throw Error{"[Error]: Cannot calculate choose of negative number"};
+    return binomial(a, b);
 }
 
-typedef double (*FUNCTION_POINTER_ARG2)(double, double);
-const std::map<std::string, FUNCTION_POINTER_ARG2> defaultFunctions_arg2{
+template<typename Number>
+using FUNCTION_POINTER_ARG2 = Number (*)(Number, Number);
+template<typename Number>
+const std::map<std::string, FUNCTION_POINTER_ARG2<Number>> defaultFunctions_arg2{
     {"min", std::fmin},
     {"max", std::fmax},
-    {"choose", defaultFunction_choose},
+    {"choose", defaultFunction_choose<Number>},
 };
 
-double defaultFunction_choice(double condition, double a, double b){
+template<typename Number>
+Number defaultFunction_choice(Number condition, Number a, Number b){
     return condition == 0? b : a;
 }
 
-typedef double (*FUNCTION_POINTER_ARG3)(double, double, double);
-const std::map<std::string, FUNCTION_POINTER_ARG3> defaultFunctions_arg3{
-    {"choice", defaultFunction_choice},
+template<typename Number>
+using FUNCTION_POINTER_ARG3 = Number (*)(Number, Number, Number);
+template<typename Number>
+const std::map<std::string, FUNCTION_POINTER_ARG3<Number>> defaultFunctions_arg3{
+    {"choice", defaultFunction_choice<Number>},
+};
+
+//Two lanes of an array reduction, for types and compilers without vector support
+template<typename Number>
+struct ScalarLanes{
+    Number lane[2];
+    Number operator[](size_t i) const{ return lane[i]; }
+    ScalarLanes& operator+=(const ScalarLanes& other){
+        lane[0] += other.lane[0];
+        lane[1] += other.lane[1];
+        return *this;
+    }
+    ScalarLanes& operator*=(const ScalarLanes& other){
+        lane[0] *= other.lane[0];
+        lane[1] *= other.lane[1];
+        return *this;
+    }
+};
+
+template<typename Number>
+void laneMin(ScalarLanes<Number>& lanes, const ScalarLanes<Number>& other){
+    lanes.lane[0] = std::fmin(lanes.lane[0], other.lane[0]);
+    lanes.lane[1] = std::fmin(lanes.lane[1], other.lane[1]);
+}
+
+template<typename Number>
+void laneMax(ScalarLanes<Number>& lanes, const ScalarLanes<Number>& other){
+    lanes.lane[0] = std::fmax(lanes.lane[0], other.lane[0]);
+    lanes.lane[1] = std::fmax(lanes.lane[1], other.lane[1]);
+}
+
+template<typename Number>
+struct LaneType{
+    using type = ScalarLanes<Number>;
+};
+
+#if defined(__GNUC__)
+//GCC and Clang hold 16 bytes of floats or doubles, one SSE or NEON register, in a vector value, so the
+//adds, multiplies and compares on them are single SIMD instructions
+template<>
+struct LaneType<float>{
+    typedef float type __attribute__((vector_size(16)));
+};
+
+template<>
+struct LaneType<double>{
+    typedef double type __attribute__((vector_size(16)));
+};
+
+//A packed compare and a bit mask instead of a call to fmin or fmax per lane. A NaN in other leaves the
+//lane as it is, as with fmin; the lanes themselves must not be NaN
+template<typename Vector>
+void laneMin(Vector& lanes, const Vector& other){
+    auto takeOther = other < lanes;
+    using Mask = decltype(takeOther);
+    lanes = (Vector)((takeOther & (Mask)other) | (~takeOther & (Mask)lanes));
+}
+
+template<typename Vector>
+void laneMax(Vector& lanes, const Vector& other){
+    auto takeOther = other > lanes;
+    using Mask = decltype(takeOther);
+    lanes = (Vector)((takeOther & (Mask)other) | (~takeOther & (Mask)lanes));
+}
+#endif
+
+template<typename Number>
+using Lanes = typename LaneType<Number>::type;
+
+template<typename Number>
+constexpr size_t laneWidth = sizeof(Lanes<Number>)/sizeof(Number);
+
+template<typename Number>
+void loadLanes(Lanes<Number>& lanes, const Number* values){
+    std::memcpy(&lanes, values, sizeof lanes);
+}
+
+template<typename Number>
+void fillLanes(Lanes<Number>& lanes, Number value){
+    Number copies[laneWidth<Number>];
+    std::fill(std::begin(copies), std::end(copies), value);
+    loadLanes(lanes, copies);
+}
+
+//The reductions below keep two sets of lanes so consecutive steps do not wait on each other
+template<typename Number>
+Number defaultFunction_sum(const BasicArray<Number>& values){
+    constexpr size_t width = laneWidth<Number>;
+    Lanes<Number> low{}, high{}, chunk;
+    size_t i = 0;
+    for (; i+2*width <= values.size(); i += 2*width){
+        loadLanes(chunk, &values[i]);
+        low += chunk;
+        loadLanes(chunk, &values[i+width]);
+        high += chunk;
+    }
+    low += high;
+    Number total = 0;
+    for (size_t lane = 0; lane < width; ++lane)
+        total += low[lane];
+    for (; i < values.size(); ++i)
+        total += values[i];
+    return total;
+}
+
+template<typename Number>
+Number defaultFunction_mean(const BasicArray<Number>& values){
+    if (values.empty())
+        throw Error{"[Error]: Cannot calculate mean of an empty array"};
+    return defaultFunction_sum(values)/values.size();
+}
+
+template<typename Number>
+Number defaultFunction_arrayMin(const BasicArray<Number>& values){
+    if (values.empty())
+        throw Error{"[Error]: Cannot calculate min of an empty array"};
+    // NaNs are skipped, so the lanes start from the first number and the result is NaN only if all are
+    size_t i = 0;
+    while (i+1 < values.size() && std::isnan(values[i]))
+        ++i;
+    constexpr size_t width = laneWidth<Number>;
+    Lanes<Number> low, high, chunk;
+    fillLanes(low, values[i]);
+    fillLanes(high, values[i]);
+    for (; i+2*width <= values.size(); i += 2*width){
+        loadLanes(chunk, &values[i]);
+        laneMin(low, chunk);
+        loadLanes(chunk, &values[i+width]);
+        laneMin(high, chunk);
+    }
+    laneMin(low, high);
+    Number result = low[0];
+    for (size_t lane = 1; lane < width; ++lane)
+        result = std::fmin(result, low[lane]);
+    for (; i < values.size(); ++i)
+        result = std::fmin(result, values[i]);
+    return result;
+}
+
+template<typename Number>
+Number defaultFunction_arrayMax(const BasicArray<Number>& values){
+    if (values.empty())
+        throw Error{"[Error]: Cannot calculate max of an empty array"};
+    // NaNs are skipped, so the lanes start from the first number and the result is NaN only if all are
+    size_t i = 0;
+    while (i+1 < values.size() && std::isnan(values[i]))
+        ++i;
+    constexpr size_t width = laneWidth<Number>;
+    Lanes<Number> low, high, chunk;
+    fillLanes(low, values[i]);
+    fillLanes(high, values[i]);
+    for (; i+2*width <= values.size(); i += 2*width){
+        loadLanes(chunk, &values[i]);
+        laneMax(low, chunk);
+        loadLanes(chunk, &values[i+width]);
+        laneMax(high, chunk);
+    }
+    laneMax(low, high);
+    Number result = low[0];
+    for (size_t lane = 1; lane < width; ++lane)
+        result = std::fmax(result, low[lane]);
+    for (; i < values.size(); ++i)
+        result = std::fmax(result, values[i]);
+    return result;
+}
+
+template<typename Number>
+Number defaultFunction_dot(const BasicArray<Number>& a, const BasicArray<Number>& b){
+    if (a.size() != b.size())
+        throw Error{std::string("[Error]: Array size mismatch (")+std::to_string(a.size())+" vs "+std::to_string(b.size())+")"};
+    constexpr size_t width = laneWidth<Number>;
+    Lanes<Number> low{}, high{}, left, right;
+    size_t i = 0;
+    for (; i+2*width <= a.size(); i += 2*width){
+        loadLanes(left, &a[i]);
+        loadLanes(right, &b[i]);
+        left *= right;
+        low += left;
+        loadLanes(left, &a[i+width]);
+        loadLanes(right, &b[i+width]);
+        left *= right;
+        high += left;
+    }
+    low += high;
+    Number total = 0;
+    for (size_t lane = 0; lane < width; ++lane)
+        total += low[lane];
+    for (; i < a.size(); ++i)
+        total += a[i]*b[i];
+    return total;
+}
+
+template<typename Number>
+using ARRAY_FUNCTION_POINTER_ARG1 = Number (*)(const BasicArray<Number>&);
+template<typename Number>
+const std::map<std::string, ARRAY_FUNCTION_POINTER_ARG1<Number>> arrayFunctions_arg1{
+    {"sum", defaultFunction_sum<Number>},
+    {"mean", defaultFunction_mean<Number>},
+    {"min", defaultFunction_arrayMin<Number>},
+    {"max", defaultFunction_arrayMax<Number>},
 };
 
-const std::map<std::string, double> constants{
-    {"pi", M_PI},
+template<typename Number>
+using ARRAY_FUNCTION_POINTER_ARG2 = Number (*)(const BasicArray<Number>&, const BasicArray<Number>&);
+template<typename Number>
+const std::map<std::string, ARRAY_FUNCTION_POINTER_ARG2<Number>> arrayFunctions_arg2{
+    {"dot", defaultFunction_dot<Number>},
 };
 
+//Builtins that bind a loop variable, called as (variable, low, high, body)
+const std::map<std::string, LoopType> loopFunctions{
+    {"sum", LoopType::Sum},
+    {"prod", LoopType::Product},
+};
+
+template<typename Number>
+const std::map<std::string, Number> constants{
+    {"pi", Number(3.14159265358979323846264338327950288L)},
+};
+
+bool isDefaultFunction(const std::string& name){
+    return defaultFunctions_arg1<double>.find(name) != defaultFunctions_arg1<double>.end() || defaultFunctions_arg2<double>.find(name) != defaultFunctions_arg2<double>.end() || defaultFunctions_arg3<double>.find(name) != defaultFunctions_arg3<double>.end() || arrayFunctions_arg1<double>.find(name) != arrayFunctions_arg1<double>.end() || arrayFunctions_arg2<double>.find(name) != arrayFunctions_arg2<double>.end() || loopFunctions.find(name) != loopFunctions.end();
+}
+
+bool isFunction(const std::string& name, const std::map<std::string, Function>& customFunctions){
+    return isDefaultFunction(name) || customFunctions.find(name) != customFunctions.end();
+}
+
+bool isArrayFunction(const std::string& name, int numArguments){
+    return (numArguments == 1 && arrayFunctions_arg1<double>.find(name) != arrayFunctions_arg1<double>.end()) || (numArguments == 2 && arrayFunctions_arg2<double>.find(name) != arrayFunctions_arg2<double>.end());
+}
+
+//Counts the comma separated arguments of a function call or array literal
+int countArguments(const std::vector<Token>& tokens){
+    if (tokens.empty())
+        return 0;
+    int depth = 0;
+    int count = 1;
+    for (const Token& token : tokens){
+        if (token.token == "(" || token.token == "[")
+            ++depth;
+        else if (token.token == ")" || token.token == "]")
+            --depth;
+        else if (token.token == "," && depth == 0)
+            ++count;
+    }
+    return count;
+}
+
+//Splits the tokens of a function call's arguments at the top level commas
+std::vector<std::vector<Token>> splitArguments(const std::vector<Token>& tokens){
+    std::vector<std::vector<Token>> arguments;
+    if (tokens.empty())
+        return arguments;
+    arguments.emplace_back();
+    int depth = 0;
+    for (const Token& token : tokens){
+        if (token.token == "(" || token.token == "[")
+            ++depth;
+        else if (token.token == ")" || token.token == "]")
+            --depth;
+        if (token.token == "," && depth == 0)
+            arguments.emplace_back();
+        else
+            arguments.back().push_back(token);
+    }
+    return arguments;
+}
+
+template<typename Number>
+std::ostream& operator<<(std::ostream& out, const BasicValue<Number>& value){
+    if (!value.isArray)
+        return out << value.scalar;
+    out << "[";
+    for (size_t i = 0; i < value.array.size(); ++i)
+        out << (i == 0? "" : ", ") << value.array[i];
+    return out << "]";
+}
+
+//Parses a number token at the full precision of Number
+template<typename Number>
+Number parseNumber(const std::string& text){
+    if constexpr (std::is_same<Number, float>::value)
+        return std::strtof(text.c_str(), nullptr);
+    else if constexpr (std::is_same<Number, long double>::value)
+        return std::strtold(text.c_str(), nullptr);
+    else
+        return std::strtod(text.c_str(), nullptr);
+}
+
+//Values of the number tokens of a postfix expression by token index, zero for every other token
+template<typename Number>
+std::vector<Number> parseLiterals(const std::vector<Token>& tokens){
+    std::vector<Number> values(tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i){
+        if (tokens[i].type == TokenType::Number)
+            values[i] = parseNumber<Number>(tokens[i].token);
+    }
+    return values;
+}
+
+//Reads numbers separated by whitespace or commas into an array
+template<typename Number>
+BasicArray<Number> loadArray(const std::string& filePath){
+    std::ifstream fin(filePath);
+    if (!fin)
+        throw Error{std::string("[Error]: File '")+filePath+"' does not exist"};
+    std::stringstream contents;
+    contents << fin.rdbuf();
+    std::string text = contents.str();
+    std::replace(text.begin(), text.end(), ',', ' ');
+    std::istringstream numbers(text);
+    BasicArray<Number> values;
+    Number value;
+    while (numbers >> value)
+        values.push_back(value);
+    if (!numbers.eof())
+        throw Error{std::string("[Error]: File '")+filePath+"' contains a value that is not a number"};
+    return values;
+}
+
+template<typename Number>
+size_t broadcastSize(const BasicValue<Number>& a, const BasicValue<Number>& b){
+    if (a.isArray && b.isArray && a.array.size() != b.array.size())
+        throw Error{std::string("[Error]: Array size mismatch (")+std::to_string(a.array.size())+" vs "+std::to_string(b.array.size())+")"};
+    return a.isArray? a.array.size() : b.size();
+}
+
+//Applies a scalar operation element-wise, a scalar operand is repeated across the array operands
+template<typename Number, typename Operation>
+BasicValue<Number> broadcast(const BasicValue<Number>& a, Operation operation){
+    if (!a.isArray)
+        return BasicValue<Number>(operation(a.scalar));
+    BasicArray<Number> result(a.array.size());
+    for (size_t i = 0; i < result.size(); ++i)
+        result[i] = operation(a.array[i]);
+    return BasicValue<Number>(std::move(result));
+}
+
+//The array/array and array/scalar cases get their own loops, without a branch per element
+template<typename Number, typename Operation>
+BasicValue<Number> broadcast(const BasicValue<Number>& a, const BasicValue<Number>& b, Operation operation){
+    if (!a.isArray && !b.isArray)
+        return BasicValue<Number>(operation(a.scalar, b.scalar));
+    BasicArray<Number> result(broadcastSize(a, b));
+    if (a.isArray && b.isArray){
+        for (size_t i = 0; i < result.size(); ++i)
+            result[i] = operation(a.array[i], b.array[i]);
+    }
+    else if (a.isArray){
+        for (size_t i = 0; i < result.size(); ++i)
+            result[i] = operation(a.array[i], b.scalar);
+    }
+    else{
+        for (size_t i = 0; i < result.size(); ++i)
+            result[i] = operation(a.scalar, b.array[i]);
+    }
+    return BasicValue<Number>(std::move(result));
+}
+
+template<typename Number, typename Operation>
+BasicValue<Number> broadcast(const BasicValue<Number>& a, const BasicValue<Number>& b, const BasicValue<Number>& c, Operation operation){
+    if (!a.isArray && !b.isArray && !c.isArray)
+        return BasicValue<Number>(operation(a.scalar, b.scalar, c.scalar));
+    broadcastSize(a, b);
+    broadcastSize(b, c);
+    broadcastSize(a, c);
+    BasicArray<Number> result(std::max(a.size(), std::max(b.size(), c.size())));
+    for (size_t i = 0; i < result.size(); ++i)
+        result[i] = operation(a[i], b[i], c[i]);
+    return BasicValue<Number>(std::move(result));
+}
+
+template<typename Number>
+BasicArray<Number> toArray(const BasicValue<Number>& value){
+    return value.isArray? value.array : BasicArray<Number>{value.scalar};
+}
+
 //Tokenize an expression into operators, operands, identifiers, and parentheses
 std::vector<Token> tokenize(const std::string& text){
     // the first char of an identifier cannot be a number or operator, a number or identifier name ends when it encounters either an operator or a parentheses
@@ -92,7 +461,7 @@ std::vector<Token> tokenize(const std::string& text){
     Token token;
     State state = State::Empty;
     for (char c : text){
-        if (c == '(' || c == ')'){
+        if (c == '(' || c == ')' || c == '[' || c == ']'){
             if (state != State::Empty)
                 tokens.push_back(token);
             Token paren;
@@ -149,7 +518,7 @@ std::vector<Token> tokenize(const std::string& text){
                     token.token += c;
                 }
                 else if (isDigit(c)){
-                    if ((token.token == "+" || token.token == "-") && (tokens.empty() || tokens.back().token == "(")){
+                    if ((token.token == "+" || token.token == "-") && (tokens.empty() || tokens.back().token == "(" || tokens.back().token == "[" || tokens.back().token == ",")){
                         token.token += c;
                         token.type = TokenType::Number;
                         state = State::Numbering;
@@ -161,7 +530,7 @@ std::vector<Token> tokenize(const std::string& text){
                     }
                 }
                 else if (isIdentifier(c)){
-                    if ((token.token == "+" || token.token == "-") && (tokens.empty() || tokens.back().token == "(")){
+                    if ((token.token == "+" || token.token == "-") && (tokens.empty() || tokens.back().token == "(" || tokens.back().token == "[" || tokens.back().token == ",")){
                         token.token += c;
                         token.type = TokenType::Identifier;
                         state = State::Identifier;
@@ -218,7 +587,28 @@ std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std
         switch (token.type){
             case TokenType::Parenthesis:
             {
-                if (token.token == "(")
+                if (token.token == "["){
+                    int bracketCount = 1;
+                    int closingBracketIndex = -1;
+                    std::vector<Token> elements;
+                    for (int i=index+1; i<(int)tokens.size(); ++i){
+                        if (tokens[i].token == "[")
+                            ++bracketCount;
+                        else if (tokens[i].token == "]"){
+                            --bracketCount;
+                            if (bracketCount == 0){
+                                closingBracketIndex = i;
+                                break;
+                            }
+                        }
+                        elements.push_back(tokens[i]);
+                    }
+                    std::vector<Token> recursedResult = convertToPostfix(elements, customFunctions, true);
+                    result.insert(result.end(), recursedResult.begin(), recursedResult.end());
+                    result.push_back(Token{TokenType::Array, "[]", countArguments(elements)});
+                    return closingBracketIndex;
+                }
+                else if (token.token == "(")
                     stack.push(token);
                 else{
                     while (stack.top().token != "("){
@@ -231,8 +621,9 @@ std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std
             }
             case TokenType::Number:
             case TokenType::Identifier:
+            case TokenType::Array:
             {
-                if ((defaultFunctions_arg1.find(token.token) != defaultFunctions_arg1.end() || defaultFunctions_arg2.find(token.token) != defaultFunctions_arg2.end() || defaultFunctions_arg3.find(token.token) != defaultFunctions_arg3.end() || customFunctions.find(token.token) != customFunctions.end()) && index != tokens.size()-1 && tokens[index+1].token == "("){
+                if (isFunction(token.token, customFunctions) && index != tokens.size()-1 && tokens[index+1].token == "("){
                     int parenCount = 1;
                     int closingParenIndex = -1;
                     std::vector<Token> functionArgs;
@@ -248,9 +639,23 @@ std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std
                         }
                         functionArgs.push_back(tokens[i]);
                     }
+                    if (auto it = loopFunctions.find(token.token); it != loopFunctions.end() && countArguments(functionArgs) == 4){
+                        // only the bounds go on the operand stack, the body is compiled separately and evaluated once per iteration
+                        std::vector<std::vector<Token>> loopArgs = splitArguments(functionArgs);
+                        if (loopArgs[0].size() != 1 || loopArgs[0][0].type != TokenType::Identifier)
+                            throw Error{std::string("[Error]: Loop variable of '")+token.token+"' must be an identifier"};
+                        for (int i = 1; i <= 2; ++i){
+                            std::vector<Token> bound = convertToPostfix(loopArgs[i], customFunctions);
+                            result.insert(result.end(), bound.begin(), bound.end());
+                        }
+                        Loop loop{it->second, loopArgs[0][0].token, convertToPostfix(loopArgs[3], customFunctions)};
+                        loop.literals = {parseLiterals<float>(loop.body), parseLiterals<double>(loop.body), parseLiterals<long double>(loop.body)};
+                        result.push_back(Token{token.type, token.token, 2, std::make_shared<const Loop>(std::move(loop))});
+                        return closingParenIndex;
+                    }
                     std::vector<Token> recursedResult = convertToPostfix(functionArgs, customFunctions, true);
                     result.insert(result.end(), recursedResult.begin(), recursedResult.end());
-                    result.push_back(token);
+                    result.push_back(Token{token.type, token.token, countArguments(functionArgs)});
                     return closingParenIndex;
                 }
                 else if (index < tokens.size()-2 && tokens[index+1].type != TokenType::Operator && tokens[index+1].token != ")")
@@ -262,7 +667,14 @@ std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std
             {
                 if (token.token == "," && !functionCall)
                     throw Error{"[Error]: Comma cannot be used outside of a function call"};
-                else if (token.token != ","){
+                else if (token.token == ","){
+                    // the operators of the previous argument end at the comma
+                    while (stack.top().type == TokenType::Operator){
+                        result.push_back(stack.top());
+                        stack.pop();
+                    }
+                }
+                else{
                     while (stack.top().type == TokenType::Operator){
                         if (getPrecedence(stack.top()) >= getPrecedence(token)){
                             result.push_back(stack.top());
@@ -287,6 +699,15 @@ std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std
         throw Error{"[Error]: More left parentheses than right"};
     else if (parenCount < 0)
         throw Error{"[Error]: More right parentheses than left"};
+    int bracketCount = 0;
+    for (const Token& token : tokens){
+        if (token.token == "[") ++bracketCount;
+        else if (token.token == "]") --bracketCount;
+    }
+    if (bracketCount > 0)
+        throw Error{"[Error]: More left brackets than right"};
+    else if (bracketCount < 0)
+        throw Error{"[Error]: More right brackets than left"};
     // start processing
     stack.push(Token{TokenType::Parenthesis, "("});
     tokens.push_back(Token{TokenType::Parenthesis, ")"});
@@ -296,154 +717,512 @@ std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std
     return result;
 }
 
-//Takes postfix notation expression as a vector of tokens
-double evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, double>& variables, const std::map<std::string, Function>& customFunctions){
-    std::stack<double> operandStack;
-    std::stack<double> ternaryOptionStack;
-    for (const Token& token : tokens){
-        if (token.type == TokenType::Number)
-            operandStack.push(std::atof(token.token.c_str()));
-        else if (token.type == TokenType::Identifier){
-            if (auto it = defaultFunctions_arg1.find(token.token); it != defaultFunctions_arg1.end()){
-                if (operandStack.size() < 1)
-                    throw Error{std::string("[Error]: Not enough arguments passed to function '")+token.token+"'"};
-                double operand = operandStack.top();
-                operandStack.pop();
-                operandStack.push(it->second(operand));
+//Limits shared by every thread of one evaluation
+struct EvaluationState{
+    const EvaluationOptions& options;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<long long> steps{0};
+    
+    EvaluationState(const EvaluationOptions& options) : options(options), deadline(std::chrono::steady_clock::now()+options.maxTime){}
+};
+
+//Counts steps locally and only touches the shared state every budgetCheckInterval steps, so the limits are cheap enough to always be on
+struct Budget{
+    EvaluationState& state;
+    long long pendingSteps = 0;
+    
+    Budget(EvaluationState& state) : state(state){}
+    
+    void step(){
+        if (++pendingSteps >= budgetCheckInterval)
+            check();
+    }
+    
+    void check(){
+        const EvaluationOptions& options = state.options;
+        long long steps = state.steps.fetch_add(pendingSteps, std::memory_order_relaxed)+pendingSteps;
+        pendingSteps = 0;
+        if (options.maxSteps > 0 && steps > options.maxSteps)
+            throw EvaluationLimitError{std::string("[Error]: Evaluation exceeded the step limit of ")+std::to_string(options.maxSteps)};
+        else if (options.cancellation && options.cancellation->isCancelled())
+            throw EvaluationLimitError{"[Error]: Evaluation cancelled"};
+        else if (options.maxTime.count() > 0 && std::chrono::steady_clock::now() > state.deadline)
+            throw EvaluationLimitError{std::string("[Error]: Evaluation exceeded the time limit of ")+std::to_string(options.maxTime.count())+"ms"};
+    }
+    
+    void enterCall(int depth){
+        if (state.options.maxCallDepth > 0 && depth > state.options.maxCallDepth)
+            throw EvaluationLimitError{std::string("[Error]: Evaluation exceeded the call depth limit of ")+std::to_string(state.options.maxCallDepth)};
+    }
+};
+
+template<typename Number>
+BasicValue<Number> evaluatePostfix(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options, Budget& budget, int depth);
+
+//Operand stacks of one postfix evaluation, the ternary operator : pushes both of its options onto the second stack for the ? that follows
+template<typename Number>
+struct OperandStacks{
+    std::stack<BasicValue<Number>> operands;
+    std::stack<BasicValue<Number>> ternaryOptions;
+};
+
+//Takes the value of a whole postfix expression off the stacks, which are left empty for the next one
+template<typename Number>
+BasicValue<Number> popResult(OperandStacks<Number>& stacks){
+    if (stacks.operands.size() > 1)
+        throw Error{"[Error]: Unused operand(s)"};
+    else if (stacks.ternaryOptions.size() > 0)
+        throw Error{"[Error]: : operator used without ternary operator ?"};
+    BasicValue<Number> result = std::move(stacks.operands.top());
+    stacks.operands.pop();
+    return result;
+}
+
+//Number tokens take their values from literals, indexed from first, when it is given
+template<typename Number>
+void evaluateTokens(const Token* first, const Token* last, OperandStacks<Number>& stacks, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options, Budget& budget, int depth, const Number* literals = nullptr);
+
+//Evaluates the body of a sum or prod for every value of its loop variable in [low, high]
+template<typename Number>
+BasicValue<Number> evaluateLoop(const Loop& loop, Number low, Number high, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options, Budget& budget, int depth){
+    if (!std::isfinite(low) || !std::isfinite(high))
+        throw Error{"[Error]: Loop bounds must be finite"};
+    if (constants<Number>.find(loop.variable) != constants<Number>.end())
+        throw Error{std::string("[Error]: Cannot use constant '")+loop.variable+"' as a loop variable"};
+    // converting a span that does not fit in long long is undefined, and no such range could finish anyway
+    if (high >= low && !(std::floor(high-low) < Number(LLONG_MAX)))
+        throw Error{"[Error]: Loop range is too long"};
+    long long count = high < low? 0 : (long long)std::floor(high-low)+1;
+    auto combine = [&](const BasicValue<Number>& a, const BasicValue<Number>& b){
+        if (loop.type == LoopType::Sum)
+            return broadcast(a, b, [](Number x, Number y){ return x+y; });
+        return broadcast(a, b, [](Number x, Number y){ return x*y; });
+    };
+    BasicValue<Number> identity = Number(loop.type == LoopType::Sum? 0 : 1);
+    // the loop variable is inserted and the stacks are allocated once per range, each iteration only overwrites the value
+    // of the variable and reads the literals of the body that were parsed with it
+    const Token* body = loop.body.data();
+    const Number* literals = loop.literalValues<Number>();
+    auto evaluateRange = [&](long long first, long long last, const EvaluationOptions& rangeOptions, Budget& rangeBudget){
+        std::map<std::string, Number> loopVariables = variables;
+        auto variable = loopVariables.insert_or_assign(loop.variable, low).first;
+        OperandStacks<Number> stacks;
+        BasicValue<Number> result = identity;
+        for (long long i = first; i < last; ++i){
+            variable->second = low+i;
+            evaluateTokens(body, body+loop.body.size(), stacks, loopVariables, arrays, customFunctions, rangeOptions, rangeBudget, depth+1, literals);
+            result = combine(result, popResult(stacks));
+        }
+        return result;
+    };
+    budget.enterCall(depth+1);
+    if (options.loopChunkSize < 1 || count <= options.loopChunkSize)
+        return evaluateRange(0, count, options, budget);
+    // chunks are handed out dynamically, but always combined in chunk order, a batch of chunks at a time to bound memory
+    long long numChunks = (count+options.loopChunkSize-1)/options.loopChunkSize;
+    long long numThreads = std::max(1LL, std::min((long long)options.loopThreads, numChunks));
+    long long batchSize = std::min(numChunks, numThreads*16);
+    std::vector<BasicValue<Number>> partialResults(batchSize);
+    std::vector<std::exception_ptr> errors(batchSize);
+    std::atomic<long long> nextChunk{0};
+    std::atomic<bool> failed{false};
+    EvaluationOptions chunkOptions = options;
+    chunkOptions.loopThreads = 1;
+    BasicValue<Number> result = identity;
+    for (long long firstChunk = 0; firstChunk < numChunks; firstChunk += batchSize){
+        long long lastChunk = std::min(numChunks, firstChunk+batchSize);
+        nextChunk = firstChunk;
+        auto worker = [&](){
+            Budget workerBudget(budget.state);
+            for (long long chunk = nextChunk++; chunk < lastChunk && !failed; chunk = nextChunk++){
+                try{
+                    partialResults[chunk-firstChunk] = evaluateRange(chunk*options.loopChunkSize, std::min(count, (chunk+1)*options.loopChunkSize), chunkOptions, workerBudget);
+                    workerBudget.check();
+                }
+                catch (...){
+                    errors[chunk-firstChunk] = std::current_exception();
+                    failed = true;
+                }
             }
-            else if (auto it = defaultFunctions_arg2.find(token.token); it != defaultFunctions_arg2.end()){
-                if (operandStack.size() < 2)
-                    throw Error{std::string("[Error]: Not enough arguments passed to function '")+token.token+"'"};
-                double operand2 = operandStack.top();
-                operandStack.pop();
-                double operand1 = operandStack.top();
-                operandStack.pop();
-                operandStack.push(it->second(operand1, operand2));
+        };
+        std::vector<std::thread> threads;
+        for (long long i = 1; i < numThreads; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads)
+            thread.join();
+        for (long long chunk = firstChunk; chunk < lastChunk; ++chunk){
+            if (errors[chunk-firstChunk])
+                std::rethrow_exception(errors[chunk-firstChunk]);
+            result = combine(result, partialResults[chunk-firstChunk]);
+        }
+    }
+    return result;
+}
+
+//Index of the first token of the operand that ends at each token of a postfix expression, empty if the expression is malformed
+//so that the serial evaluation reports the error. The options of a : are only ever the second operand of the ? that follows it
+std::vector<int> operandStarts(const std::vector<Token>& tokens){
+    std::vector<int> starts(tokens.size());
+    // the first token of every operand on the stack, and whether it is the options of a :
+    std::vector<std::pair<int, bool>> operands;
+    for (int i = 0; i < (int)tokens.size(); ++i){
+        const Token& token = tokens[i];
+        // every single character operator other than ? and : takes two operands
+        char op = token.type == TokenType::Operator && token.token.size() == 1? token.token[0] : '\0';
+        int numOperands = 0;
+        if (op == ',')
+            return {};
+        else if (token.type == TokenType::Operator)
+            numOperands = 2;
+        else if (token.type == TokenType::Array || token.numArguments >= 0)
+            numOperands = token.numArguments;
+        if ((int)operands.size() < numOperands)
+            return {};
+        for (int k = 0; k < numOperands; ++k){
+            if (operands[operands.size()-numOperands+k].second != (op == '?' && k == 1))
+                return {};
+        }
+        starts[i] = numOperands > 0? operands[operands.size()-numOperands].first : i;
+        operands.resize(operands.size()-numOperands);
+        operands.push_back({starts[i], op == ':'});
+    }
+    if (operands.size() != 1 || operands[0].second)
+        return {};
+    return starts;
+}
+
+//Shared by the tasks that evaluate one large expression
+template<typename Number>
+struct ParallelEvaluation{
+    const std::vector<Token>& tokens;
+    const std::vector<int>& starts;
+    const std::map<std::string, Number>& variables;
+    const std::map<std::string, BasicArray<Number>>& arrays;
+    const std::map<std::string, Function>& customFunctions;
+    const EvaluationOptions& options;
+    EvaluationState& state;
+    TaskPool& pool;
+};
+
+//Operands nested deeper than this inside split operands are evaluated serially, so a deeply nested expression cannot overflow the stack
+const int maxSplitDepth = 64;
+
+//Evaluates the operand that ends at token last. A long operand is split into its operands, a chain of binary operators along its
+//left side is flattened into one list, and consecutive operands are grouped into tasks of about expressionTaskSize tokens.
+//A group of a chain of only + or only * is folded inside its task, everything else is combined in order on the calling thread
+template<typename Number>
+BasicValue<Number> evaluateOperand(const ParallelEvaluation<Number>& evaluation, int last, Budget& budget, int level){
+    const std::vector<Token>& tokens = evaluation.tokens;
+    const std::vector<int>& starts = evaluation.starts;
+    const long long taskSize = evaluation.options.expressionTaskSize;
+    auto apply = [&](int from, int to, OperandStacks<Number>& stacks, Budget& taskBudget){
+        evaluateTokens(tokens.data()+from, tokens.data()+to+1, stacks, evaluation.variables, evaluation.arrays, evaluation.customFunctions, evaluation.options, taskBudget, 0);
+    };
+    auto isBinary = [&](int index){
+        return tokens[index].type == TokenType::Operator && tokens[index].token != "?" && tokens[index].token != ":";
+    };
+    auto length = [&](int index){
+        return index-starts[index]+1;
+    };
+    if (length(last) <= taskSize || level > maxSplitDepth){
+        OperandStacks<Number> stacks;
+        apply(starts[last], last, stacks, budget);
+        return std::move(stacks.operands.top());
+    }
+    // the last token of every operand, the operator that combines it with the operands before it, and the tokens applied after all of them
+    std::vector<int> operands;
+    std::vector<int> combiners;
+    std::vector<int> finalTokens;
+    if (isBinary(last)){
+        int node = last;
+        for (; isBinary(node) && length(node) > taskSize; node = starts[node-1]-1){
+            operands.push_back(node-1);
+            combiners.push_back(node);
+        }
+        operands.push_back(node);
+        combiners.push_back(-1);
+        std::reverse(operands.begin(), operands.end());
+        std::reverse(combiners.begin(), combiners.end());
+    }
+    else{
+        int numOperands = tokens[last].type == TokenType::Operator? 2 : tokens[last].numArguments;
+        for (int k = 0, child = last-1; k < numOperands; ++k, child = starts[child]-1)
+            operands.push_back(child);
+        std::reverse(operands.begin(), operands.end());
+        // the options of a ternary operator are evaluated as two operands and paired by applying its :
+        if (tokens[last].token == "?"){
+            int options = operands.back();
+            operands.back() = starts[options-1]-1;
+            operands.push_back(options-1);
+            finalTokens.push_back(options);
+        }
+        combiners.assign(operands.size(), -1);
+        finalTokens.push_back(last);
+    }
+    // groups depend only on the lengths of the operands, so the result does not depend on the number of threads
+    struct Group{
+        size_t first;
+        size_t last;
+        bool folded;
+    };
+    std::vector<Group> groups;
+    for (size_t i = 0; i < operands.size();){
+        size_t j = i;
+        for (long long size = 0; j < operands.size() && (j == i || size+length(operands[j]) <= taskSize); ++j)
+            size += length(operands[j]);
+        bool folded = j-i > 1 && combiners[i+1] >= 0;
+        for (size_t k = i+1; k < j && folded; ++k){
+            const std::string& op = tokens[combiners[k]].token;
+            folded = (op == "+" || op == "*") && op == tokens[combiners[i+1]].token && (i == 0 || tokens[combiners[i]].token == op);
+        }
+        groups.push_back(Group{i, j, folded});
+        i = j;
+    }
+    std::vector<std::vector<BasicValue<Number>>> groupValues(groups.size());
+    std::vector<std::function<void()>> tasks;
+    for (size_t g = 0; g < groups.size(); ++g){
+        tasks.push_back([&, g](){
+            const Group& group = groups[g];
+            Budget taskBudget(evaluation.state);
+            if (group.last-group.first == 1)
+                groupValues[g].push_back(evaluateOperand(evaluation, operands[group.first], taskBudget, level+1));
+            else{
+                OperandStacks<Number> stacks;
+                for (size_t k = group.first; k < group.last; ++k){
+                    apply(starts[operands[k]], operands[k], stacks, taskBudget);
+                    if (group.folded && k > group.first)
+                        apply(combiners[k], combiners[k], stacks, taskBudget);
+                }
+                groupValues[g].resize(stacks.operands.size());
+                for (auto value = groupValues[g].rbegin(); value != groupValues[g].rend(); ++value){
+                    *value = std::move(stacks.operands.top());
+                    stacks.operands.pop();
+                }
             }
-            else if (auto it = defaultFunctions_arg3.find(token.token); it != defaultFunctions_arg3.end()){
-                if (operandStack.size() < 3)
-                    throw Error{std::string("[Error]: Not enough arguments passed to function '")+token.token+"'"};
-                double operand3 = operandStack.top();
-                operandStack.pop();
-                double operand2 = operandStack.top();
-                operandStack.pop();
-                double operand1 = operandStack.top();
-                operandStack.pop();
-                operandStack.push(it->second(operand1, operand2, operand3));
+            taskBudget.check();
+        });
+    }
+    evaluation.pool.run(tasks);
+    OperandStacks<Number> stacks;
+    for (size_t g = 0; g < groups.size(); ++g){
+        const Group& group = groups[g];
+        for (size_t k = group.first; k < group.last; ++k){
+            if (group.folded && k > group.first)
+                break;
+            stacks.operands.push(std::move(groupValues[g][k-group.first]));
+            if (combiners[k] >= 0)
+                apply(combiners[k], combiners[k], stacks, budget);
+        }
+    }
+    for (int token : finalTokens)
+        apply(token, token, stacks, budget);
+    return std::move(stacks.operands.top());
+}
+
+//Takes postfix notation expression as a vector of tokens
+template<typename Number>
+BasicValue<Number> evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options){
+    EvaluationState state(options);
+    Budget budget(state);
+    TaskPool* pool = options.expressionPool;
+    if (pool && pool->size() > 1 && options.expressionTaskSize > 0 && (long long)tokens.size() > options.expressionTaskSize){
+        if (std::vector<int> starts = operandStarts(tokens); !starts.empty())
+            return evaluateOperand(ParallelEvaluation<Number>{tokens, starts, variables, arrays, customFunctions, options, state, *pool}, (int)tokens.size()-1, budget, 0);
+    }
+    return evaluatePostfix(tokens, variables, arrays, customFunctions, options, budget, 0);
+}
+
+template<typename Number>
+BasicValue<Number> evaluatePostfix(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options, Budget& budget, int depth){
+    OperandStacks<Number> stacks;
+    evaluateTokens(tokens.data(), tokens.data()+tokens.size(), stacks, variables, arrays, customFunctions, options, budget, depth);
+    return popResult(stacks);
+}
+
+//Applies the tokens in [first, last) to the operand stacks
+template<typename Number>
+void evaluateTokens(const Token* first, const Token* last, OperandStacks<Number>& stacks, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options, Budget& budget, int depth, const Number* literals){
+    std::stack<BasicValue<Number>>& operandStack = stacks.operands;
+    std::stack<BasicValue<Number>>& ternaryOptionStack = stacks.ternaryOptions;
+    auto popOperand = [&](){
+        BasicValue<Number> operand = std::move(operandStack.top());
+        operandStack.pop();
+        return operand;
+    };
+    for (const Token* current = first; current != last; ++current){
+        const Token& token = *current;
+        budget.step();
+        if (token.type == TokenType::Number)
+            operandStack.push(literals? literals[current-first] : parseNumber<Number>(token.token));
+        else if (token.type == TokenType::Array){
+            if ((int)operandStack.size() < token.numArguments)
+                throw Error{"[Error]: Not enough elements in array"};
+            std::vector<BasicValue<Number>> elements(token.numArguments);
+            for (auto i = elements.rbegin(); i != elements.rend(); ++i)
+                *i = popOperand();
+            // arrays nested inside an array literal are concatenated
+            BasicArray<Number> array;
+            for (const BasicValue<Number>& element : elements){
+                if (element.isArray)
+                    array.insert(array.end(), element.array.begin(), element.array.end());
+                else
+                    array.push_back(element.scalar);
             }
-            else if (auto it = customFunctions.find(token.token); it != customFunctions.end()){
-                double operand;
-                std::map<std::string, double> tempVariables;
-                for (auto i = it->second.argumentNames.rbegin(); i != it->second.argumentNames.rend(); ++i) {
-                    if (!operandStack.empty()){
-                        operand = operandStack.top();
-                        operandStack.pop();
-                    }
+            operandStack.push(std::move(array));
+        }
+        else if (token.loop){
+            if (operandStack.size() < 2)
+                throw Error{std::string("[Error]: Not enough arguments passed to function '")+token.token+"'"};
+            BasicValue<Number> high = popOperand();
+            BasicValue<Number> low = popOperand();
+            if (low.isArray || high.isArray)
+                throw Error{std::string("[Error]: Bounds of '")+token.token+"' must be scalars"};
+            operandStack.push(evaluateLoop(*token.loop, low.scalar, high.scalar, variables, arrays, customFunctions, options, budget, depth));
+        }
+        else if (token.type == TokenType::Identifier && token.numArguments >= 0){
+            if ((int)operandStack.size() < token.numArguments)
+                throw Error{std::string("[Error]: Not enough arguments passed to function '")+token.token+"'"};
+            std::vector<BasicValue<Number>> arguments(token.numArguments);
+            for (auto i = arguments.rbegin(); i != arguments.rend(); ++i)
+                *i = popOperand();
+            if (auto it = defaultFunctions_arg1<Number>.find(token.token); it != defaultFunctions_arg1<Number>.end() && arguments.size() == 1)
+                operandStack.push(broadcast(arguments[0], it->second));
+            else if (auto it = arrayFunctions_arg1<Number>.find(token.token); it != arrayFunctions_arg1<Number>.end() && arguments.size() == 1)
+                operandStack.push(arguments[0].isArray? it->second(arguments[0].array) : it->second(BasicArray<Number>{arguments[0].scalar}));
+            else if (auto it = defaultFunctions_arg2<Number>.find(token.token); it != defaultFunctions_arg2<Number>.end() && arguments.size() == 2)
+                operandStack.push(broadcast(arguments[0], arguments[1], it->second));
+            else if (auto it = arrayFunctions_arg2<Number>.find(token.token); it != arrayFunctions_arg2<Number>.end() && arguments.size() == 2)
+                operandStack.push(it->second(toArray(arguments[0]), toArray(arguments[1])));
+            else if (auto it = defaultFunctions_arg3<Number>.find(token.token); it != defaultFunctions_arg3<Number>.end() && arguments.size() == 3)
+                operandStack.push(broadcast(arguments[0], arguments[1], arguments[2], it->second));
+            else if (auto it = customFunctions.find(token.token); it != customFunctions.end() && arguments.size() == it->second.argumentNames.size()){
+                budget.enterCall(depth+1);
+                std::map<std::string, Number> tempVariables;
+                std::map<std::string, BasicArray<Number>> tempArrays;
+                for (size_t i = 0; i < arguments.size(); ++i){
+                    if (arguments[i].isArray)
+                        tempArrays[it->second.argumentNames[i]] = std::move(arguments[i].array);
                     else
-                        throw Error{std::string("[Error]: Not enough arguments passed to function '")+token.token+"'"};
-                    tempVariables[*i] = operand;
+                        tempVariables[it->second.argumentNames[i]] = arguments[i].scalar;
                 }
-                operandStack.push(evaluateExpression(it->second.funcExpression, tempVariables, customFunctions));
+                operandStack.push(evaluatePostfix(it->second.funcExpression, tempVariables, tempArrays, customFunctions, options, budget, depth+1));
             }
-            else if (auto it = constants.find(token.token); it != constants.end())
-                operandStack.push(it->second);
-            else if (auto it = constants.find(token.token.substr(1, token.token.length()-1)); it != constants.end()){
-                if (token.token[0] == '+')
-                    operandStack.push(it->second);
-                else if(token.token[0] == '-')
-                    operandStack.push(-(it->second));
-            }
-            else if (auto it = variables.find(token.token); it != variables.end())
-                operandStack.push(it->second);
-            else if (auto it = variables.find(token.token.substr(1, token.token.length()-1)); it != variables.end()){
-                if (token.token[0] == '+')
-                    operandStack.push(it->second);
-                else if(token.token[0] == '-')
-                    operandStack.push(-(it->second));
+            else
+                throw Error{std::string("[Error]: Incorrect number of arguments passed to function '")+token.token+"'"};
+        }
+        else if (token.type == TokenType::Identifier){
+            std::string name = token.token;
+            bool negate = false;
+            if (name[0] == '+' || name[0] == '-'){
+                negate = name[0] == '-';
+                name.erase(0, 1);
             }
+            if (auto it = constants<Number>.find(name); it != constants<Number>.end())
+                operandStack.push(negate? -(it->second) : it->second);
+            else if (auto it = variables.find(name); it != variables.end())
+                operandStack.push(negate? -(it->second) : it->second);
+            else if (auto it = arrays.find(name); it != arrays.end())
+                operandStack.push(negate? broadcast(BasicValue<Number>(it->second), [](Number x){ return -x; }) : BasicValue<Number>(it->second));
             else
                 throw Error{std::string("[Error]: Unrecognized identifier '")+token.token+"'"};
         }
         else if (token.type == TokenType::Operator){
-            double a, b;
+            BasicValue<Number> a, b;
             if ((operandStack.size() < 2 && token.token != "?") || (operandStack.size() < 1 && token.token == "?")){
                 throw Error{std::string("[Error]: Operator does not have enough operands: ")+token.token};
             }
             else if (token.token == "?"){
-                a = operandStack.top();
-                operandStack.pop();
+                a = popOperand();
                 b = -1;
             }
             else{
-                b = operandStack.top();
-                operandStack.pop();
-                a = operandStack.top();
-                operandStack.pop();
+                b = popOperand();
+                a = popOperand();
             }
             if (token.token == "%")
-                operandStack.push(fmod(a, b));
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return std::fmod(x, y); }));
             else if (token.token == "+")
-                operandStack.push(a+b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return x+y; }));
             else if (token.token == "-")
-                operandStack.push(a-b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return x-y; }));
             else if (token.token == "*")
-                operandStack.push(a*b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return x*y; }));
             else if (token.token == "/")
-                operandStack.push(a/b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return x/y; }));
             else if (token.token == "<")
-                operandStack.push(a<b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x<y); }));
             else if (token.token == ">")
-                operandStack.push(a>b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x>y); }));
             else if (token.token == "<=")
-                operandStack.push(a<=b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x<=y); }));
             else if (token.token == ">=")
-                operandStack.push(a>=b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x>=y); }));
             else if (token.token == "==")
-                operandStack.push(a==b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x==y); }));
             else if (token.token == "&&")
-                operandStack.push(a&&b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x&&y); }));
             else if (token.token == "||")
-                operandStack.push(a||b);
+                operandStack.push(broadcast(a, b, [](Number x, Number y){ return Number(x||y); }));
             else if (token.token == "^"){
-                if (a < 0 && b < 1)
-                    throw Error{std::string("[Error]: ")+std::to_string(a)+"^"+std::to_string(b)+" is not a number"};
-                operandStack.push(pow(a, b));
+                operandStack.push(broadcast(a, b, [](Number x, Number y){
+                    if (x < 0 && y < 1)
+                        throw Error{std::string("[Error]: ")+std::to_string(x)+"^"+std::to_string(y)+" is not a number"};
+                    return fastPow(x, y);
+                }));
             }
             else if (token.token == ":"){
-                ternaryOptionStack.push(a);
-                ternaryOptionStack.push(b);
+                ternaryOptionStack.push(std::move(a));
+                ternaryOptionStack.push(std::move(b));
             }
             else if (token.token == "?"){
                 if (ternaryOptionStack.size() < 2)
                     throw Error{"[Error]: Ternary operator ? used without operator :"};
-                double op2 = ternaryOptionStack.top();
+                BasicValue<Number> op2 = std::move(ternaryOptionStack.top());
                 ternaryOptionStack.pop();
-                double op1 = ternaryOptionStack.top();
+                BasicValue<Number> op1 = std::move(ternaryOptionStack.top());
                 ternaryOptionStack.pop();
-                operandStack.push(a?op1:op2);
+                operandStack.push(broadcast(a, op1, op2, defaultFunction_choice<Number>));
             }
             else if (token.token != ","){
                 throw Error{std::string("[Error]: Invalid operator: ")+token.token};
             }
         }
     }
-    if (operandStack.size() > 1)
-        throw Error{"[Error]: Unused operand(s)"};
-    else if (ternaryOptionStack.size() > 0)
-        throw Error{"[Error]: : operator used without ternary operator ?"};
-    return operandStack.top();
+}
+
+template<typename Number>
+Number scalarResult(const BasicValue<Number>& value){
+    if (value.isArray)
+        throw Error{"[Error]: Expression evaluates to an array"};
+    return value.scalar;
+}
+
+//Scalar only version of the above, throws if the expression evaluates to an array
+template<typename Number>
+Number evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, Function>& customFunctions){
+    return scalarResult(evaluateExpression(tokens, variables, std::map<std::string, BasicArray<Number>>{}, customFunctions));
 }
 
 //Overload that the user should call
-double evaluateExpression(const std::string& expression, std::map<std::string, double>& variables, std::map<std::string, Function>& customFunctions){
+template<typename Number>
+BasicValue<Number> evaluateExpression(const std::string& expression, std::map<std::string, Number>& variables, std::map<std::string, BasicArray<Number>>& arrays, std::map<std::string, Function>& customFunctions, const EvaluationOptions& options){
     std::vector<Token> tokenized = tokenize(expression);
     if (auto it = std::find(tokenized.begin(), tokenized.end(), Token{TokenType::Operator, "="}); it != tokenized.end()){
         if (it == tokenized.begin()+1){
             std::vector<Token> rightSide = tokenized;
             rightSide.erase(rightSide.begin(), rightSide.begin()+2);
-            double value = evaluateExpression(convertToPostfix(rightSide, customFunctions), variables, customFunctions);
-            if (constants.find(tokenized[0].token) == constants.end())
-                variables[tokenized[0].token] = value;
+            BasicValue<Number> value = evaluateExpression(convertToPostfix(rightSide, customFunctions), variables, arrays, customFunctions, options);
+            if (constants<Number>.find(tokenized[0].token) == constants<Number>.end()){
+                if (value.isArray){
+                    variables.erase(tokenized[0].token);
+                    arrays[tokenized[0].token] = std::move(value.array);
+                }
+                else{
+                    arrays.erase(tokenized[0].token);
+                    variables[tokenized[0].token] = value.scalar;
+                }
+            }
         }
         else{
             Function function{0, std::vector<std::string>{}, std::vector<Token>{}};
@@ -460,19 +1239,34 @@ double evaluateExpression(const std::string& expression, std::map<std::string, d
             std::vector<Token> rightSide = tokenized;
             rightSide.erase(rightSide.begin(), find(rightSide.begin(), rightSide.end(), Token{TokenType::Operator, "="})+1);
             function.funcExpression = convertToPostfix(rightSide, customFunctions);
-            if (defaultFunctions_arg1.find(tokenized[0].token) == defaultFunctions_arg1.end() && defaultFunctions_arg2.find(tokenized[0].token) == defaultFunctions_arg2.end() && defaultFunctions_arg3.find(tokenized[0].token) == defaultFunctions_arg3.end())
+            if (!isDefaultFunction(tokenized[0].token))
                 customFunctions[tokenized[0].token] = function;
             else
                 throw Error{std::string("[Error]: Cannot overwrite default function '")+tokenized[0].token+"'"};
         }
     }
     else
-        return evaluateExpression(convertToPostfix(tokenized, customFunctions, true), variables, customFunctions);
+        return evaluateExpression(convertToPostfix(tokenized, customFunctions, true), variables, arrays, customFunctions, options);
     return 0;
 }
 
-void evaluateFile(const std::string& filePath){
-    std::map<std::string, double> variables;
+//Scalar only version of the above
+template<typename Number>
+Number evaluateExpression(const std::string& expression, std::map<std::string, Number>& variables, std::map<std::string, Function>& customFunctions){
+    // assign into a copy so an array result leaves the variables untouched
+    std::map<std::string, Number> updated = variables;
+    std::map<std::string, BasicArray<Number>> arrays;
+    BasicValue<Number> result = evaluateExpression(expression, updated, arrays, customFunctions);
+    if (!arrays.empty())
+        throw Error{"[Error]: Array variables require an array table"};
+    Number scalar = scalarResult(result);
+    variables.swap(updated);
+    return scalar;
+}
+
+template<typename Number>
+void evaluateFile(const std::string& filePath, std::map<std::string, BasicArray<Number>> arrays, const EvaluationOptions& options){
+    std::map<std::string, Number> variables;
     std::map<std::string, Function> customFunctions;
     std::ifstream fin(filePath);
     if (!fin)
@@ -481,9 +1275,32 @@ void evaluateFile(const std::string& filePath){
     while (!fin.eof()) {
         getline(fin, line);
         if (!line.empty()){
-            double result = evaluateExpression(line, variables, customFunctions);
+            BasicValue<Number> result = evaluateExpression(line, variables, arrays, customFunctions, options);
             if (std::find(line.begin(), line.end(), '=') == line.end())
                 std::cout << result << "\n";
         }
     }
 }
+
+//Compile the evaluator once for each scalar type it can be run with
+#define INSTANTIATE_EVALUATOR(Number) \
+    template Number factorial(Number n); \
+    template Number defaultFunction_choose(Number a, Number b); \
+    template Number defaultFunction_choice(Number condition, Number a, Number b); \
+    template Number defaultFunction_sum(const BasicArray<Number>& values); \
+    template Number defaultFunction_mean(const BasicArray<Number>& values); \
+    template Number defaultFunction_arrayMin(const BasicArray<Number>& values); \
+    template Number defaultFunction_arrayMax(const BasicArray<Number>& values); \
+    template Number defaultFunction_dot(const BasicArray<Number>& a, const BasicArray<Number>& b); \
+    template Number parseNumber(const std::string& text); \
+    template std::ostream& operator<<(std::ostream& out, const BasicValue<Number>& value); \
+    template BasicArray<Number> loadArray(const std::string& filePath); \
+    template BasicValue<Number> evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& customFunctions, const EvaluationOptions& options); \
+    template Number evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, Function>& customFunctions); \
+    template BasicValue<Number> evaluateExpression(const std::string& expression, std::map<std::string, Number>& variables, std::map<std::string, BasicArray<Number>>& arrays, std::map<std::string, Function>& customFunctions, const EvaluationOptions& options); \
+    template Number evaluateExpression(const std::string& expression, std::map<std::string, Number>& variables, std::map<std::string, Function>& customFunctions); \
+    template void evaluateFile(const std::string& filePath, std::map<std::string, BasicArray<Number>> arrays, const EvaluationOptions& options);
+
+INSTANTIATE_EVALUATOR(float)
+INSTANTIATE_EVALUATOR(double)
+INSTANTIATE_EVALUATOR(long double)
@@ -1,8 +1,14 @@
 #pragma once
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <exception>
 #include <map>
+#include <memory>
+#include <ostream>
 #include <vector>
 
 enum class State{
@@ -17,6 +23,7 @@ enum class TokenType{
     Operator = 2,
     Identifier = 3,
     Parenthesis = 4,
+    Array = 5,
 };
 
 struct Error : std::exception{
@@ -29,9 +36,22 @@ struct Error : std::exception{
     }
 };
 
+//Thrown when an evaluation runs out of its budget or is cancelled
+struct EvaluationLimitError : Error{
+    EvaluationLimitError(const std::string& err_message) : Error(err_message){}
+};
+
+struct Loop;
+
+class TaskPool;
+
 struct Token{
     TokenType type;
     std::string token;
+    //Number of arguments of a function call or elements of an array literal, -1 for every other token
+    int numArguments = -1;
+    //Set on sum and prod calls that bind a loop variable
+    std::shared_ptr<const Loop> loop;
     
     void initialize(TokenType t, char c){
         type = t;
@@ -48,25 +68,178 @@ struct Token{
     }
 };
 
+enum class LoopType{
+    Sum = 0,
+    Product = 1,
+};
+
+//sum(i, low, high, body) or prod(i, low, high, body), the body is compiled once and evaluated for i = low, low+1, ..., high
+struct Loop{
+    LoopType type;
+    std::string variable;
+    std::vector<Token> body;
+    //The number tokens of the body parsed once for each number type, by token index, so iterations do not parse them again
+    std::tuple<std::vector<float>, std::vector<double>, std::vector<long double>> literals;
+    
+    template<typename Number>
+    const Number* literalValues() const{
+        return std::get<std::vector<Number>>(literals).data();
+    }
+};
+
+//Shared flag that a controlling thread sets to stop the evaluations that were given it
+struct CancellationToken{
+    std::atomic<bool> cancelled{false};
+    
+    void cancel(){
+        cancelled.store(true, std::memory_order_relaxed);
+    }
+    
+    bool isCancelled() const{
+        return cancelled.load(std::memory_order_relaxed);
+    }
+};
+
+//Limits are checked once every budgetCheckInterval steps, so an evaluation may overrun maxSteps by this much per thread
+const long long budgetCheckInterval = 256;
+
+//Settings that apply to a whole evaluation
+struct EvaluationOptions{
+    //Number of threads that sum and prod split large ranges across
+    unsigned loopThreads = 1;
+    //Ranges longer than this are evaluated in chunks of this size whose results are combined in order, so the result does not depend on loopThreads
+    long long loopChunkSize = 65536;
+    //Pool that the independent operands of a large expression are evaluated across, owned by the caller so that its threads serve
+    //every evaluation it is passed to. nullptr, or a pool of one thread, evaluates serially
+    TaskPool* expressionPool = nullptr;
+    //With more than one thread, expressions longer than this many tokens are split into tasks of about this size whose results are combined in order,
+    //so the result is the same for any number of threads but a long + or * chain may round differently from the serial evaluation
+    long long expressionTaskSize = 65536;
+    //Tokens evaluated across every loop iteration and function call, 0 for no limit
+    long long maxSteps = 0;
+    //Nesting depth of custom function calls and loop bodies, 0 for no limit. A level takes about 1 KB of stack optimized and 4 KB unoptimized,
+    //so the default stays well within the 512 KB stack of a secondary thread on macOS
+    int maxCallDepth = 64;
+    //Wall time the evaluation may take, 0 for no limit
+    std::chrono::milliseconds maxTime{0};
+    //Checked alongside the other limits, nullptr if the evaluation cannot be cancelled
+    const CancellationToken* cancellation = nullptr;
+};
+
+template<typename Number>
+using BasicArray = std::vector<Number>;
+
+typedef BasicArray<double> Array;
+
+//A scalar or an array of scalars, operators and builtins broadcast scalars across arrays element-wise
+template<typename Number>
+struct BasicValue{
+    bool isArray = false;
+    Number scalar = 0;
+    BasicArray<Number> array;
+    
+    BasicValue() = default;
+    BasicValue(Number scalar) : scalar(scalar){}
+    BasicValue(BasicArray<Number> array) : isArray(true), array(std::move(array)){}
+    
+    size_t size() const{
+        return isArray? array.size() : 1;
+    }
+    
+    Number operator[](size_t index) const{
+        return isArray? array[index] : scalar;
+    }
+};
+
+typedef BasicValue<double> Value;
+
+template<typename Number>
+std::ostream& operator<<(std::ostream& out, const BasicValue<Number>& value);
+
 struct Function{
     int numArguments;
     std::vector<std::string> argumentNames;
     std::vector<Token> funcExpression;
 };
 
+//Precedence of an operator, -1 if it is not one, constexpr so compiled expressions share the table
+constexpr int precedenceOf(std::string_view op){
+    if (op == "?")
+        return 0;
+    else if (op == ":")
+        return 1;
+    else if (op == "<" || op == ">" || op == "<=" || op == ">=" || op == "==" || op == "&&" || op == "||")
+        return 2;
+    else if (op == "+" || op == "-")
+        return 3;
+    else if (op == "*" || op == "/" || op == "%")
+        return 4;
+    else if (op == "^")
+        return 5;
+    return -1;
+}
+
 int getPrecedence(const Token& op);
 
-bool isDigit(char c);
+constexpr bool isDigit(char c){
+    return ((c-'0') >= 0 && (c-'0') <= 9) || c == '.';
+}
+
+constexpr bool isOperator(char c){
+    return c == '%' || c == '+' || c == '-' || c == '*' || c == '/' || c == '^' || c == '<' || c == '>' || c == '=' || c == '&' || c == '|' || c == '?' || c == ':' || c == ',';
+}
+
+constexpr bool isIdentifier(char c){
+    return ((c-'a') <= ('z'-'a') && (c-'a') >= 0) || ((c-'A') <= ('Z'-'A') && (c-'A') >= 0) || c == '_';
+}
+
+//The evaluator and its builtin tables are templates over the scalar type, instantiated for float, double and long double
+
+template<typename Number>
+Number factorial(Number n);
 
-bool isOperator(char c);
+template<typename Number>
+Number defaultFunction_choose(Number a, Number b);
 
-bool isIdentifier(char c);
+template<typename Number>
+Number defaultFunction_choice(Number condition, Number a, Number b);
 
-double factorial(double n);
+//Reductions over arrays, accumulated in SIMD lanes (for float and double with GCC and Clang)
+template<typename Number>
+Number defaultFunction_sum(const BasicArray<Number>& values);
 
-double defaultFunction_choose(double a, double b);
+template<typename Number>
+Number defaultFunction_mean(const BasicArray<Number>& values);
 
-double defaultFunction_choice(double condition, double a, double b);
+template<typename Number>
+Number defaultFunction_arrayMin(const BasicArray<Number>& values);
+
+template<typename Number>
+Number defaultFunction_arrayMax(const BasicArray<Number>& values);
+
+template<typename Number>
+Number defaultFunction_dot(const BasicArray<Number>& a, const BasicArray<Number>& b);
+
+//Parses a number token at the full precision of Number
+template<typename Number>
+Number parseNumber(const std::string& text);
+
+bool isDefaultFunction(const std::string& name);
+
+bool isFunction(const std::string& name, const std::map<std::string, Function>& customFunctions);
+
+//Whether a call with this many arguments reduces arrays to a scalar, like sum(xs) or dot(xs, ys)
+bool isArrayFunction(const std::string& name, int numArguments);
+
+//Counts the comma separated arguments of a function call or array literal
+int countArguments(const std::vector<Token>& tokens);
+
+//Splits the tokens of a function call's arguments at the top level commas
+std::vector<std::vector<Token>> splitArguments(const std::vector<Token>& tokens);
+
+//Reads numbers separated by whitespace or commas into an array
+template<typename Number = double>
+BasicArray<Number> loadArray(const std::string& filePath);
 
 //Tokenize an expression into operators, operands, identifiers, and parentheses
 std::vector<Token> tokenize(const std::string& text);
@@ -86,9 +259,20 @@ struct EvaluationContext
 std::vector<Token> convertToPostfix(const std::vector<Token>& tokens_, const std::map<std::string, Function>& customFunctions, bool functionCall = false);
 
 //Takes postfix notation expression as a vector of tokens
-double evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, double>& variables, const std::map<std::string, Function>& functions);
+template<typename Number>
+BasicValue<Number> evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, BasicArray<Number>>& arrays, const std::map<std::string, Function>& functions, const EvaluationOptions& options = EvaluationOptions{});
+
+//Scalar only version of the above, throws if the expression evaluates to an array
+template<typename Number>
+Number evaluateExpression(const std::vector<Token>& tokens, const std::map<std::string, Number>& variables, const std::map<std::string, Function>& functions);
 
 //Overload that the user calls
-double evaluateExpression(const std::string& expression, std::map<std::string, double>& variables, std::map<std::string, Function>& customFunctions);
+template<typename Number>
+BasicValue<Number> evaluateExpression(const std::string& expression, std::map<std::string, Number>& variables, std::map<std::string, BasicArray<Number>>& arrays, std::map<std::string, Function>& customFunctions, const EvaluationOptions& options = EvaluationOptions{});
+
+//Scalar only version of the above
+template<typename Number>
+Number evaluateExpression(const std::string& expression, std::map<std::string, Number>& variables, std::map<std::string, Function>& customFunctions);
 
-void evaluateFile(const std::string& filePath);
+template<typename Number = double>
+void evaluateFile(const std::string& filePath, std::map<std::string, BasicArray<Number>> arrays = {}, const EvaluationOptions& options = EvaluationOptions{});
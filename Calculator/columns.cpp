@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "columns.hpp"
+
+//from_chars and to_chars for floating point need library support that some standard libraries still lack
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define HAS_FLOATING_CHARCONV 1
+#else
+#define HAS_FLOATING_CHARCONV 0
+#endif
+
+//Maps a whole file read only, the mapping lives as long as the object
+class MappedFile{
+public:
+    explicit MappedFile(const std::string& filePath){
+        int descriptor = open(filePath.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            throw Error{std::string("[Error]: File '")+filePath+"' does not exist"};
+        struct stat status;
+        if (fstat(descriptor, &status) != 0){
+            close(descriptor);
+            throw Error{std::string("[Error]: File '")+filePath+"' could not be read"};
+        }
+        length = status.st_size;
+        if (length > 0){
+            void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address == MAP_FAILED){
+                close(descriptor);
+                throw Error{std::string("[Error]: File '")+filePath+"' could not be mapped"};
+            }
+            madvise(address, length, MADV_SEQUENTIAL);
+            contents = static_cast<const char*>(address);
+        }
+        // the mapping stays valid after the descriptor is closed
+        close(descriptor);
+    }
+
+    ~MappedFile(){
+        if (contents)
+            munmap(const_cast<char*>(contents), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const{
+        return contents;
+    }
+
+    size_t size() const{
+        return length;
+    }
+
+private:
+    const char* contents = nullptr;
+    size_t length = 0;
+};
+
+//Parses a number the way parseNumber does, for values from_chars cannot represent or when it is not available
+template<typename Number>
+bool parseWithStrtod(const char* first, const char* last, Number& value){
+    char buffer[128];
+    size_t length = last-first;
+    if (length == 0 || length >= sizeof(buffer))
+        return false;
+    std::memcpy(buffer, first, length);
+    buffer[length] = '\0';
+    char* end = nullptr;
+    if constexpr (std::is_same_v<Number, float>)
+        value = std::strtof(buffer, &end);
+    else if constexpr (std::is_same_v<Number, double>)
+        value = std::strtod(buffer, &end);
+    else
+        value = std::strtold(buffer, &end);
+    return end == buffer+length;
+}
+
+//Parses one CSV field, surrounding spaces are ignored
+template<typename Number>
+bool parseField(const char* first, const char* last, Number& value){
+    while (first < last && (*first == ' ' || *first == '\t'))
+        ++first;
+    while (last > first && (last[-1] == ' ' || last[-1] == '\t'))
+        --last;
+#if HAS_FLOATING_CHARCONV
+    // from_chars does not accept a leading +
+    const char* start = last-first > 1 && *first == '+' && first[1] != '-'? first+1 : first;
+    auto [end, error] = std::from_chars(start, last, value);
+    if (error == std::errc::result_out_of_range)
+        return parseWithStrtod(first, last, value);
+    return start < last && error == std::errc() && end == last;
+#else
+    return parseWithStrtod(first, last, value);
+#endif
+}
+
+//Appends the shortest text that reads back as value, and a newline
+template<typename Number>
+void appendNumber(std::string& text, Number value){
+    char buffer[64];
+#if HAS_FLOATING_CHARCONV
+    char* end = std::to_chars(buffer, buffer+sizeof(buffer), value).ptr;
+#else
+    int length;
+    if constexpr (std::is_same_v<Number, long double>)
+        length = std::snprintf(buffer, sizeof(buffer), "%.*Lg", std::numeric_limits<Number>::max_digits10, value);
+    else
+        length = std::snprintf(buffer, sizeof(buffer), "%.*g", std::numeric_limits<Number>::max_digits10, double(value));
+    char* end = buffer+length;
+#endif
+    text.append(buffer, end);
+    text += '\n';
+}
+
+const char* findNewline(const char* first, const char* last){
+    const void* newline = std::memchr(first, '\n', last-first);
+    return newline? static_cast<const char*>(newline) : last;
+}
+
+//Adds the names an expression reads, including inside loop bodies, and rejects everything that combines rows. The names that the
+//bounds of a sum or prod read also go to boundNames, a chunk evaluates each loop once so its bounds cannot change from row to row.
+//Returns the names the whole expression reads, loop variables shadow the columns of the same name inside their bodies
+std::set<std::string> collectNames(const std::vector<Token>& tokens, std::set<std::string>& names, std::set<std::string>& boundNames, const std::set<std::string>& loopVariables = {}){
+    // the names read by each operand on the stack, combined the way the evaluator pops operands
+    std::vector<std::set<std::string>> operands;
+    for (const Token& token : tokens){
+        if (token.type == TokenType::Array)
+            throw Error{"[Error]: Array literals cannot be used when streaming rows"};
+        else if (token.type == TokenType::Identifier && isArrayFunction(token.token, token.numArguments))
+            throw Error{std::string("[Error]: '")+token.token+"' combines rows and cannot be used when streaming rows"};
+        std::set<std::string> read;
+        if (token.type == TokenType::Identifier && token.numArguments < 0){
+            std::string name = token.token[0] == '+' || token.token[0] == '-'? token.token.substr(1) : token.token;
+            if (loopVariables.count(name) == 0){
+                names.insert(name);
+                read.insert(name);
+            }
+        }
+        size_t numOperands = std::min(operands.size(), size_t(token.type == TokenType::Operator? 2 : std::max(token.numArguments, 0)));
+        for (size_t k = operands.size()-numOperands; k < operands.size(); ++k)
+            read.insert(operands[k].begin(), operands[k].end());
+        operands.resize(operands.size()-numOperands);
+        if (token.loop){
+            boundNames.insert(read.begin(), read.end());
+            std::set<std::string> bodyVariables = loopVariables;
+            bodyVariables.insert(token.loop->variable);
+            std::set<std::string> bodyNames = collectNames(token.loop->body, names, boundNames, bodyVariables);
+            read.insert(bodyNames.begin(), bodyNames.end());
+        }
+        operands.push_back(std::move(read));
+    }
+    std::set<std::string> read;
+    for (const std::set<std::string>& operand : operands)
+        read.insert(operand.begin(), operand.end());
+    return read;
+}
+
+std::vector<Token> compileRowExpression(const std::string& expression, std::set<std::string>& names, std::set<std::string>& boundNames){
+    std::map<std::string, Function> functions;
+    std::vector<Token> postfix = convertToPostfix(tokenize(expression), functions);
+    collectNames(postfix, names, boundNames);
+    return postfix;
+}
+
+void checkLoopBounds(const std::set<std::string>& boundNames, const std::string& column){
+    if (boundNames.count(column) > 0)
+        throw Error{std::string("[Error]: Loop bounds cannot depend on column '")+column+"' when streaming rows"};
+}
+
+//Evaluates the expression once over a chunk with every column bound as an array, so each row gets its own element of the result
+template<typename Number>
+std::string evaluateRows(const std::vector<Token>& postfix, const std::map<std::string, BasicArray<Number>>& columns, size_t numRows, const EvaluationOptions& options){
+    std::string text;
+    if (numRows == 0)
+        return text;
+    std::map<std::string, Number> variables;
+    std::map<std::string, Function> functions;
+    BasicValue<Number> result = evaluateExpression(postfix, variables, columns, functions, options);
+    if (result.isArray && result.array.size() != numRows)
+        throw Error{"[Error]: Expression does not evaluate to one value per row"};
+    text.reserve(numRows*(std::numeric_limits<Number>::max_digits10+8));
+    for (size_t row = 0; row < numRows; ++row)
+        appendNumber(text, result[row]);
+    return text;
+}
+
+//Runs process(i) for chunks i = 0, 1, ... on worker threads and writes the text each returns in chunk order. claim(i) is called in order
+//under a lock and returns false once chunk i is past the end of the input, it is only called while fewer than window chunks wait to be written
+void streamChunks(unsigned threads, unsigned window, const std::function<bool(long long)>& claim, const std::function<std::string(long long)>& process, std::ostream& output){
+    threads = std::max(1u, threads);
+    window = std::max(1u, window);
+    struct Slot{
+        bool ready = false;
+        std::string text;
+        std::exception_ptr error;
+    };
+    std::vector<Slot> slots(window);
+    std::mutex mutex;
+    std::condition_variable changed;
+    long long nextChunk = 0;
+    long long written = 0;
+    long long numChunks = -1;
+    bool stopped = false;
+    auto worker = [&](){
+        while (true){
+            long long chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&](){ return stopped || numChunks >= 0 || nextChunk < written+window; });
+                if (stopped || numChunks >= 0)
+                    return;
+                chunk = nextChunk;
+                if (!claim(chunk)){
+                    numChunks = chunk;
+                    changed.notify_all();
+                    return;
+                }
+                ++nextChunk;
+            }
+            Slot slot;
+            slot.ready = true;
+            try{
+                slot.text = process(chunk);
+            }
+            catch (...){
+                slot.error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slots[chunk%window] = std::move(slot);
+            }
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i)
+        workers.emplace_back(worker);
+    auto stop = [&](){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        changed.notify_all();
+        for (std::thread& thread : workers)
+            thread.join();
+    };
+    try{
+        for (long long chunk = 0;; ++chunk){
+            Slot slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&](){ return slots[chunk%window].ready || (numChunks >= 0 && chunk >= numChunks); });
+                if (!slots[chunk%window].ready)
+                    break;
+                slot = std::move(slots[chunk%window]);
+                slots[chunk%window] = Slot{};
+                written = chunk+1;
+            }
+            changed.notify_all();
+            if (slot.error)
+                std::rethrow_exception(slot.error);
+            output.write(slot.text.data(), slot.text.size());
+            if (!output)
+                throw Error{"[Error]: Results could not be written"};
+        }
+    }
+    catch (...){
+        stop();
+        throw;
+    }
+    stop();
+}
+
+template<typename Number>
+long long evaluateCsv(const std::string& expression, const std::string& filePath, std::ostream& output, const StreamOptions& options){
+    std::set<std::string> names;
+    std::set<std::string> boundNames;
+    std::vector<Token> postfix = compileRowExpression(expression, names, boundNames);
+    MappedFile file(filePath);
+    if (file.size() == 0)
+        throw Error{std::string("[Error]: File '")+filePath+"' is empty"};
+    const char* end = file.data()+file.size();
+    const char* headerEnd = findNewline(file.data(), end);
+    // the header names every column, a column is only parsed when the expression reads it
+    std::vector<std::string> header;
+    std::vector<bool> used;
+    for (const char* field = file.data();;){
+        const char* fieldEnd = std::find(field, headerEnd, ',');
+        std::string name(field, fieldEnd);
+        name.erase(std::remove_if(name.begin(), name.end(), [](char c){ return c == ' ' || c == '\t' || c == '\r' || c == '"'; }), name.end());
+        if (name.empty())
+            throw Error{std::string("[Error]: File '")+filePath+"' has an unnamed column"};
+        bool isUsed = names.count(name) > 0;
+        if (isUsed && std::find(header.begin(), header.end(), name) != header.end())
+            throw Error{std::string("[Error]: Column '")+name+"' appears more than once"};
+        checkLoopBounds(boundNames, name);
+        header.push_back(name);
+        used.push_back(isUsed);
+        if (fieldEnd == headerEnd)
+            break;
+        field = fieldEnd+1;
+    }
+    size_t window = std::max(1u, options.maxChunksInFlight);
+    size_t chunkSize = std::max<size_t>(1, options.chunkSize);
+    std::vector<std::pair<const char*, const char*>> ranges(window);
+    const char* cursor = headerEnd == end? end : headerEnd+1;
+    std::atomic<long long> numRows{0};
+    auto claim = [&](long long chunk){
+        if (cursor == end)
+            return false;
+        const char* last = size_t(end-cursor) > chunkSize? findNewline(cursor+chunkSize, end) : end;
+        if (last != end)
+            ++last;
+        ranges[chunk%window] = {cursor, last};
+        cursor = last;
+        return true;
+    };
+    auto process = [&](long long chunk){
+        auto [first, last] = ranges[chunk%window];
+        std::map<std::string, BasicArray<Number>> columns;
+        std::vector<BasicArray<Number>*> targets(header.size(), nullptr);
+        for (size_t i = 0; i < header.size(); ++i){
+            if (used[i])
+                targets[i] = &columns[header[i]];
+        }
+        size_t rows = 0;
+        for (const char* line = first; line < last;){
+            const char* lineEnd = findNewline(line, last);
+            const char* next = lineEnd == last? last : lineEnd+1;
+            if (lineEnd > line && lineEnd[-1] == '\r')
+                --lineEnd;
+            if (lineEnd == line){
+                line = next;
+                continue;
+            }
+            size_t field = 0;
+            for (const char* fieldStart = line; ; ++field){
+                const char* fieldEnd = std::find(fieldStart, lineEnd, ',');
+                if (field < targets.size() && targets[field]){
+                    Number value;
+                    if (!parseField(fieldStart, fieldEnd, value))
+                        throw Error{std::string("[Error]: Column '")+header[field]+"' contains a value that is not a number: "+std::string(fieldStart, fieldEnd)};
+                    targets[field]->push_back(value);
+                }
+                if (fieldEnd == lineEnd)
+                    break;
+                fieldStart = fieldEnd+1;
+            }
+            if (field+1 != header.size())
+                throw Error{std::string("[Error]: Row has ")+std::to_string(field+1)+" fields, expected "+std::to_string(header.size())+": "+std::string(line, lineEnd)};
+            ++rows;
+            line = next;
+        }
+        numRows += rows;
+        return evaluateRows(postfix, columns, rows, options.evaluation);
+    };
+    streamChunks(options.threads, (unsigned)window, claim, process, output);
+    return numRows;
+}
+
+template<typename Number>
+long long evaluateBinaryColumns(const std::string& expression, const std::map<std::string, std::string>& columnPaths, std::ostream& output, const StreamOptions& options){
+    std::set<std::string> names;
+    std::set<std::string> boundNames;
+    std::vector<Token> postfix = compileRowExpression(expression, names, boundNames);
+    if (columnPaths.empty())
+        throw Error{"[Error]: No columns to evaluate over"};
+    std::vector<std::pair<std::string, std::unique_ptr<MappedFile>>> files;
+    long long numRows = -1;
+    for (const auto& [name, path] : columnPaths){
+        checkLoopBounds(boundNames, name);
+        auto file = std::make_unique<MappedFile>(path);
+        if (file->size()%sizeof(Number) != 0)
+            throw Error{std::string("[Error]: Size of file '")+path+"' is not a multiple of "+std::to_string(sizeof(Number))+" bytes"};
+        long long rows = file->size()/sizeof(Number);
+        if (numRows >= 0 && rows != numRows)
+            throw Error{std::string("[Error]: Column '")+name+"' has "+std::to_string(rows)+" rows, expected "+std::to_string(numRows)};
+        numRows = rows;
+        if (names.count(name) > 0)
+            files.emplace_back(name, std::move(file));
+    }
+    long long rowsPerChunk = std::max<long long>(1, options.chunkSize/sizeof(Number));
+    long long numChunks = (numRows+rowsPerChunk-1)/rowsPerChunk;
+    auto claim = [&](long long chunk){
+        return chunk < numChunks;
+    };
+    auto process = [&](long long chunk){
+        long long first = chunk*rowsPerChunk;
+        long long rows = std::min(rowsPerChunk, numRows-first);
+        std::map<std::string, BasicArray<Number>> columns;
+        for (const auto& [name, file] : files){
+            BasicArray<Number>& column = columns[name];
+            column.resize(rows);
+            std::memcpy(column.data(), file->data()+first*sizeof(Number), rows*sizeof(Number));
+        }
+        return evaluateRows(postfix, columns, rows, options.evaluation);
+    };
+    streamChunks(options.threads, options.maxChunksInFlight, claim, process, output);
+    return numRows;
+}
+
+#define INSTANTIATE_STREAMING(Number) \
+    template long long evaluateCsv<Number>(const std::string& expression, const std::string& filePath, std::ostream& output, const StreamOptions& options); \
+    template long long evaluateBinaryColumns<Number>(const std::string& expression, const std::map<std::string, std::string>& columnPaths, std::ostream& output, const StreamOptions& options);
+
+INSTANTIATE_STREAMING(float)
+INSTANTIATE_STREAMING(double)
+INSTANTIATE_STREAMING(long double)
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "calculator.hpp"
+
+//Streams an expression over the rows of a data file. The input is memory mapped and split into chunks that worker threads parse
+//and evaluate, each chunk at once with its columns bound as arrays, while the calling thread writes the results of earlier chunks
+//in order, one value per line. Expressions that combine rows, like sum(x) or [x, y], are rejected
+
+//Settings for streaming an expression over a data file
+struct StreamOptions{
+    //Threads that parse and evaluate chunks, the calling thread only writes results
+    unsigned threads = 1;
+    //Bytes of input per chunk, a CSV chunk is extended to the end of its last row
+    size_t chunkSize = 1 << 20;
+    //Chunks being parsed or waiting to be written at once, so memory stays around this many chunks whatever the size of the input
+    unsigned maxChunksInFlight = 16;
+    //Limits that apply to the evaluation of each chunk
+    EvaluationOptions evaluation;
+};
+
+//Evaluates expression for every row of a CSV file whose first line names its columns, columns are bound to the variables
+//of the same name and only the columns the expression uses are parsed. Returns the number of rows
+template<typename Number = double>
+long long evaluateCsv(const std::string& expression, const std::string& filePath, std::ostream& output, const StreamOptions& options = {});
+
+//Same for binary columns, each file holds the values of one column as raw Number in native byte order. Returns the number of rows
+template<typename Number = double>
+long long evaluateBinaryColumns(const std::string& expression, const std::map<std::string, std::string>& columnPaths, std::ostream& output, const StreamOptions& options = {});
@@ -0,0 +1,594 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "calculator.hpp"
+#include "numeric.hpp"
+
+//Compile time expressions: compileExpression runs the tokenizer and postfix conversion in a constant expression, so a malformed
+//formula fails the build, and evaluateCompiled expands the resulting tree into inline code over the variable values.
+//  static constexpr auto area = compileExpression("pi*r^2");
+//  double a = evaluateCompiled<area>(2.0);
+//Variables are passed in the order they first appear in the expression. Numbers, variables, pi, the operators, the ternary
+//operator and the scalar builtins are supported; custom functions, arrays and sum/prod loops are not.
+//Evaluation follows the runtime: both branches of ?: and choice are evaluated, and errors carry the runtime's text. Numbers round
+//as the runtime parses them; the few that cannot be rounded correctly in a constant expression (more than 2^digits in the mantissa,
+//or a power of ten that is not exact) are parsed on first use instead, so they cannot appear in a static_assert. The compiled
+//form still rejects with messages of its own what it does not support, numbers with no digits or more than one decimal point,
+//which the runtime reads as far as they parse, and a few misplaced commas and ternary operators that the runtime only reports later
+
+enum class CompiledOperation{
+    Number = 0,
+    Pi = 1,
+    Variable = 2,
+    Negate = 3,
+    Add = 4,
+    Subtract = 5,
+    Multiply = 6,
+    Divide = 7,
+    Modulo = 8,
+    Power = 9,
+    Less = 10,
+    Greater = 11,
+    LessEqual = 12,
+    GreaterEqual = 13,
+    Equal = 14,
+    And = 15,
+    Or = 16,
+    Ternary = 17,
+    Sin = 18,
+    Cos = 19,
+    Tan = 20,
+    Abs = 21,
+    Sqrt = 22,
+    Cbrt = 23,
+    Floor = 24,
+    Ceil = 25,
+    Factorial = 26,
+    Min = 27,
+    Max = 28,
+    Choose = 29,
+    Choice = 30,
+};
+
+//A node of the expression tree, numbers are kept as mantissa*10^exponent so each scalar type rounds them at its own precision,
+//along with their digits for the ones that cannot be rounded correctly that way
+struct CompiledNode{
+    CompiledOperation operation = CompiledOperation::Number;
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    //set when digits past the 19th are not zero and were dropped from the mantissa
+    bool truncated = false;
+    std::string_view text;
+    int variable = -1;
+    int numArguments = 0;
+    int arguments[3] = {-1, -1, -1};
+};
+
+struct CompiledFunction{
+    std::string_view name;
+    CompiledOperation operation;
+    int numArguments;
+};
+
+inline constexpr CompiledFunction compiledFunctions[]{
+    {"sin", CompiledOperation::Sin, 1},
+    {"cos", CompiledOperation::Cos, 1},
+    {"tan", CompiledOperation::Tan, 1},
+    {"abs", CompiledOperation::Abs, 1},
+    {"sqrt", CompiledOperation::Sqrt, 1},
+    {"cbrt", CompiledOperation::Cbrt, 1},
+    {"floor", CompiledOperation::Floor, 1},
+    {"ceil", CompiledOperation::Ceil, 1},
+    {"factorial", CompiledOperation::Factorial, 1},
+    {"min", CompiledOperation::Min, 2},
+    {"max", CompiledOperation::Max, 2},
+    {"choose", CompiledOperation::Choose, 2},
+    {"choice", CompiledOperation::Choice, 3},
+};
+
+//A token of a compiled expression, viewing the expression text
+struct CompiledToken{
+    TokenType type = TokenType::Number;
+    std::string_view token;
+};
+
+//Same state machine as tokenize, writes at most text.size() tokens and returns how many it wrote
+constexpr int tokenizeCompiled(std::string_view text, CompiledToken* tokens){
+    int numTokens = 0;
+    TokenType type = TokenType::Number;
+    size_t start = 0;
+    State state = State::Empty;
+    for (size_t i = 0; i < text.size(); ++i){
+        char c = text[i];
+        auto pushToken = [&](){
+            tokens[numTokens++] = CompiledToken{type, text.substr(start, i-start)};
+        };
+        auto startToken = [&](TokenType t, State s){
+            type = t;
+            start = i;
+            state = s;
+        };
+        bool signPosition = numTokens == 0 || tokens[numTokens-1].token == "(" || tokens[numTokens-1].token == "[" || tokens[numTokens-1].token == ",";
+        bool signOperator = text.substr(start, i-start) == "+" || text.substr(start, i-start) == "-";
+        if (c == '(' || c == ')' || c == '[' || c == ']'){
+            if (state != State::Empty)
+                pushToken();
+            tokens[numTokens++] = CompiledToken{TokenType::Parenthesis, text.substr(i, 1)};
+            state = State::Empty;
+            continue;
+        }
+        switch (state){
+            case State::Empty:
+            {
+                if (isDigit(c))
+                    startToken(TokenType::Number, State::Numbering);
+                else if (isOperator(c))
+                    startToken(TokenType::Operator, State::Operator);
+                else if (isIdentifier(c))
+                    startToken(TokenType::Identifier, State::Identifier);
+                else if (c != ' ')
+                    throw Error{std::string("[Error]: Unrecognized symbol: ")+c};
+                break;
+            }
+            case State::Numbering:
+            {
+                if (isDigit(c))
+                    break;
+                else if (isOperator(c)){
+                    pushToken();
+                    startToken(TokenType::Operator, State::Operator);
+                }
+                else if (isIdentifier(c)){
+                    pushToken();
+                    startToken(TokenType::Identifier, State::Identifier);
+                }
+                else if (c == ' '){
+                    pushToken();
+                    state = State::Empty;
+                }
+                else
+                    throw Error{std::string("[Error]: Unrecognized symbol: ")+c};
+                break;
+            }
+            case State::Operator:
+            {
+                if (isOperator(c))
+                    break;
+                else if (isDigit(c) || isIdentifier(c)){
+                    TokenType next = isDigit(c)? TokenType::Number : TokenType::Identifier;
+                    State nextState = isDigit(c)? State::Numbering : State::Identifier;
+                    if (signOperator && signPosition){
+                        type = next;
+                        state = nextState;
+                    }
+                    else{
+                        pushToken();
+                        startToken(next, nextState);
+                    }
+                }
+                else if (c == ' '){
+                    pushToken();
+                    state = State::Empty;
+                }
+                else
+                    throw Error{std::string("[Error]: Unrecognized symbol: ")+c};
+                break;
+            }
+            case State::Identifier:
+            {
+                if (isIdentifier(c) || (isDigit(c) && c != '.'))
+                    break;
+                else if (isOperator(c)){
+                    pushToken();
+                    startToken(TokenType::Operator, State::Operator);
+                }
+                else if (c == ' '){
+                    pushToken();
+                    state = State::Empty;
+                }
+                else
+                    throw Error{std::string("[Error]: Unrecognized symbol: ")+c};
+                break;
+            }
+        }
+    }
+    if (state != State::Empty)
+        tokens[numTokens++] = CompiledToken{type, text.substr(start)};
+    return numTokens;
+}
+
+//Parses the digits of a number token without its sign, exact while the mantissa fits in 19 digits
+constexpr CompiledNode parseCompiledNumber(std::string_view text){
+    CompiledNode node;
+    node.text = text;
+    bool fraction = false;
+    int digits = 0;
+    for (char c : text){
+        if (c == '.'){
+            if (fraction)
+                throw Error{"[Error]: Number has more than one decimal point"};
+            fraction = true;
+        }
+        else if (node.mantissa < 1000000000000000000ULL){
+            node.mantissa = node.mantissa*10+(c-'0');
+            node.exponent -= fraction;
+            ++digits;
+        }
+        else{
+            node.exponent += !fraction;
+            node.truncated = node.truncated || c != '0';
+        }
+    }
+    if (digits == 0)
+        throw Error{"[Error]: Number has no digits"};
+    return node;
+}
+
+template<typename Number>
+constexpr Number decimalValue(unsigned long long mantissa, int exponent){
+    Number scale = 1;
+    for (int i = 0; i < (exponent < 0? -exponent : exponent); ++i)
+        scale *= 10;
+    return exponent < 0? Number(mantissa)/scale : Number(mantissa)*scale;
+}
+
+//Whether decimalValue rounds a number node correctly: when its mantissa and power of ten are both exact in Number, the one
+//multiplication or division rounds the exact value once, as the runtime's parser does
+template<typename Number>
+constexpr bool isExactDecimal(const CompiledNode& node){
+    constexpr int digits = std::numeric_limits<Number>::digits;
+    if (node.truncated)
+        return false;
+    if constexpr (digits < 64){
+        if (node.mantissa > (1ULL << digits))
+            return false;
+    }
+    Number limit = 1;
+    for (int i = 0; i < digits; ++i)
+        limit *= 2;
+    // 10^n is exact while 5^n fits in the digits
+    Number power = 1;
+    for (int i = 0; i < (node.exponent < 0? -node.exponent : node.exponent); ++i){
+        power *= 5;
+        if (power >= limit)
+            return false;
+    }
+    return true;
+}
+
+//The value of a number node, from the runtime's parser when decimalValue would round it differently
+template<typename Number>
+constexpr Number compiledNumber(const CompiledNode& node){
+    if (isExactDecimal<Number>(node))
+        return decimalValue<Number>(node.mantissa, node.exponent);
+    return parseNumber<Number>(std::string(node.text));
+}
+
+//Applies an operation to already evaluated arguments, the ternary operator and choice are handled by the callers
+template<typename Number>
+constexpr Number applyCompiledOperation(CompiledOperation operation, Number a, Number b){
+    switch (operation){
+        case CompiledOperation::Negate: return -a;
+        case CompiledOperation::Add: return a+b;
+        case CompiledOperation::Subtract: return a-b;
+        case CompiledOperation::Multiply: return a*b;
+        case CompiledOperation::Divide: return a/b;
+        case CompiledOperation::Modulo: return std::fmod(a, b);
+        case CompiledOperation::Power:
+            if (a < 0 && b < 1)
+                throw Error{std::string("[Error]: ")+std::to_string(a)+"^"+std::to_string(b)+" is not a number"};
+            return fastPow(a, b);
+        case CompiledOperation::Less: return a < b;
+        case CompiledOperation::Greater: return a > b;
+        case CompiledOperation::LessEqual: return a <= b;
+        case CompiledOperation::GreaterEqual: return a >= b;
+        case CompiledOperation::Equal: return a == b;
+        case CompiledOperation::And: return a && b;
+        case CompiledOperation::Or: return a || b;
+        case CompiledOperation::Sin: return std::sin(a);
+        case CompiledOperation::Cos: return std::cos(a);
+        case CompiledOperation::Tan: return std::tan(a);
+        case CompiledOperation::Abs: return std::fabs(a);
+        case CompiledOperation::Sqrt: return std::sqrt(a);
+        case CompiledOperation::Cbrt: return std::cbrt(a);
+        case CompiledOperation::Floor: return std::floor(a);
+        case CompiledOperation::Ceil: return std::ceil(a);
+        case CompiledOperation::Factorial: return factorial(a);
+        case CompiledOperation::Min: return std::fmin(a, b);
+        case CompiledOperation::Max: return std::fmax(a, b);
+        case CompiledOperation::Choose: return defaultFunction_choose(a, b);
+        default: throw Error{"[Error]: Invalid compiled operation"};
+    }
+}
+
+template<size_t Length>
+struct CompiledExpression{
+    //every token adds at most one node, and a signed operand one more to negate it
+    CompiledNode nodes[2*Length]{};
+    int numNodes = 0;
+    int root = -1;
+    std::string_view variableNames[Length]{};
+    int numVariables = 0;
+
+    //Tokenizes text and converts it to an expression tree with the same precedence rules as convertToPostfix
+    constexpr explicit CompiledExpression(std::string_view text){
+        CompiledToken tokens[Length+1]{};
+        int numTokens = tokenizeCompiled(text, tokens);
+        int parenCount = 0;
+        for (int i = 0; i < numTokens; ++i){
+            if (tokens[i].token == "[" || tokens[i].token == "]")
+                throw Error{"[Error]: Arrays are not supported in compiled expressions"};
+            else if (tokens[i].token == "(") ++parenCount;
+            else if (tokens[i].token == ")") --parenCount;
+        }
+        if (parenCount > 0)
+            throw Error{"[Error]: More left parentheses than right"};
+        else if (parenCount < 0)
+            throw Error{"[Error]: More right parentheses than left"};
+        // as in convertToPostfix the whole expression is wrapped in parentheses
+        tokens[numTokens++] = CompiledToken{TokenType::Parenthesis, ")"};
+        CompiledToken stack[Length+2]{};
+        int stackOperands[Length+2]{};
+        // for a function on the stack, the index of its first argument token
+        int stackArguments[Length+2]{};
+        int stackSize = 0;
+        int operands[2*Length+1]{};
+        int numOperands = 0;
+        stack[stackSize++] = CompiledToken{TokenType::Parenthesis, "("};
+        auto addNode = [&](CompiledNode node){
+            nodes[numNodes] = node;
+            operands[numOperands++] = numNodes;
+            return numNodes++;
+        };
+        auto popOperand = [&](std::string_view op){
+            if (numOperands == 0)
+                throw Error{std::string("[Error]: Operator does not have enough operands: ")+std::string(op)};
+            return operands[--numOperands];
+        };
+        // as at runtime, an operator's precedence is only looked up once it is compared with another
+        auto precedence = [&](std::string_view op){
+            int result = precedenceOf(op);
+            if (result < 0)
+                throw Error{std::string("[Error]: Unrecognized operator (")+std::string(op)+")"};
+            return result;
+        };
+        // the runtime converts function arguments on their own, so it numbers their tokens from the first argument
+        auto tokenNumber = [&](int index){
+            for (int i = stackSize-1; i >= 0; --i){
+                if (stack[i].type == TokenType::Identifier)
+                    return index-stackArguments[i];
+            }
+            return index;
+        };
+        auto emitOperator = [&](std::string_view op){
+            if (op == "?"){
+                int options = popOperand(op);
+                if (nodes[options].operation != CompiledOperation::Ternary || nodes[options].arguments[0] != -1)
+                    throw Error{"[Error]: Ternary operator ? used without operator :"};
+                nodes[options].arguments[0] = popOperand(op);
+                operands[numOperands++] = options;
+                return;
+            }
+            CompiledNode node;
+            node.numArguments = 2;
+            node.arguments[2] = popOperand(op);
+            node.arguments[1] = popOperand(op);
+            if (op == ":"){
+                // the condition is filled in by the ? that follows
+                node.operation = CompiledOperation::Ternary;
+                node.numArguments = 3;
+                node.arguments[0] = -1;
+                addNode(node);
+                return;
+            }
+            node.arguments[0] = node.arguments[1];
+            node.arguments[1] = node.arguments[2];
+            node.arguments[2] = -1;
+            if (op == "+") node.operation = CompiledOperation::Add;
+            else if (op == "-") node.operation = CompiledOperation::Subtract;
+            else if (op == "*") node.operation = CompiledOperation::Multiply;
+            else if (op == "/") node.operation = CompiledOperation::Divide;
+            else if (op == "%") node.operation = CompiledOperation::Modulo;
+            else if (op == "^") node.operation = CompiledOperation::Power;
+            else if (op == "<") node.operation = CompiledOperation::Less;
+            else if (op == ">") node.operation = CompiledOperation::Greater;
+            else if (op == "<=") node.operation = CompiledOperation::LessEqual;
+            else if (op == ">=") node.operation = CompiledOperation::GreaterEqual;
+            else if (op == "==") node.operation = CompiledOperation::Equal;
+            else if (op == "&&") node.operation = CompiledOperation::And;
+            else if (op == "||") node.operation = CompiledOperation::Or;
+            else
+                throw Error{std::string("[Error]: Invalid operator: ")+std::string(op)};
+            addNode(node);
+        };
+        auto addOperand = [&](const CompiledToken& token){
+            std::string_view name = token.token;
+            bool negate = name[0] == '-';
+            if (name[0] == '+' || name[0] == '-')
+                name.remove_prefix(1);
+            CompiledNode node;
+            if (token.type == TokenType::Number)
+                node = parseCompiledNumber(name);
+            else if (name == "pi")
+                node.operation = CompiledOperation::Pi;
+            else{
+                node.operation = CompiledOperation::Variable;
+                node.variable = variableIndex(name);
+                if (node.variable < 0){
+                    node.variable = numVariables;
+                    variableNames[numVariables++] = name;
+                }
+            }
+            int index = addNode(node);
+            if (negate){
+                --numOperands;
+                CompiledNode negation;
+                negation.operation = CompiledOperation::Negate;
+                negation.numArguments = 1;
+                negation.arguments[0] = index;
+                addNode(negation);
+            }
+        };
+        for (int index = 0; index < numTokens; ++index){
+            const CompiledToken& token = tokens[index];
+            bool followedByParen = index+1 < numTokens && tokens[index+1].token == "(";
+            if (token.type == TokenType::Parenthesis && token.token == "("){
+                stack[stackSize] = token;
+                stackOperands[stackSize++] = numOperands;
+            }
+            else if (token.type == TokenType::Parenthesis){
+                while (stack[stackSize-1].type == TokenType::Operator)
+                    emitOperator(stack[--stackSize].token);
+                int numArguments = numOperands-stackOperands[--stackSize];
+                if (stackSize > 0 && stack[stackSize-1].type == TokenType::Identifier){
+                    std::string_view name = stack[--stackSize].token;
+                    // min or max of a single scalar reduces it to itself, as the runtime's array reductions do
+                    if ((name == "min" || name == "max") && numArguments == 1)
+                        continue;
+                    CompiledNode node;
+                    for (const CompiledFunction& function : compiledFunctions){
+                        if (function.name == name){
+                            if (function.numArguments != numArguments)
+                                throw Error{std::string("[Error]: Incorrect number of arguments passed to function '")+std::string(name)+"'"};
+                            node.operation = function.operation;
+                            node.numArguments = numArguments;
+                        }
+                    }
+                    for (int i = numArguments-1; i >= 0; --i)
+                        node.arguments[i] = popOperand(name);
+                    addNode(node);
+                }
+            }
+            else if (token.type == TokenType::Identifier && followedByParen){
+                bool found = false;
+                for (const CompiledFunction& function : compiledFunctions)
+                    found = found || function.name == token.token;
+                if (!found)
+                    throw Error{"[Error]: Function is not supported in compiled expressions"};
+                stackArguments[stackSize] = index+2;
+                stack[stackSize++] = token;
+            }
+            else if (token.type == TokenType::Number || token.type == TokenType::Identifier){
+                if (index+1 < numTokens && tokens[index+1].type != TokenType::Operator && tokens[index+1].token != ")")
+                    throw Error{std::string("[Error]: Operator omitted | Token #: ")+std::to_string(tokenNumber(index))};
+                addOperand(token);
+            }
+            else if (token.token == ","){
+                // a comma outside a function call leaves an operand that is reported as unused, as at runtime
+                while (stack[stackSize-1].type == TokenType::Operator)
+                    emitOperator(stack[--stackSize].token);
+            }
+            else{
+                while (stack[stackSize-1].type == TokenType::Operator){
+                    int top = precedence(stack[stackSize-1].token);
+                    if (top < precedence(token.token))
+                        break;
+                    emitOperator(stack[--stackSize].token);
+                }
+                stack[stackSize++] = token;
+            }
+        }
+        if (numOperands != 1)
+            throw Error{numOperands == 0? "[Error]: Empty expression" : "[Error]: Unused operand(s)"};
+        for (int i = 0; i < numNodes; ++i){
+            if (nodes[i].operation == CompiledOperation::Ternary && nodes[i].arguments[0] == -1)
+                throw Error{"[Error]: : operator used without ternary operator ?"};
+        }
+        root = operands[0];
+    }
+
+    //Position of a variable in the argument list, -1 if the expression does not use it
+    constexpr int variableIndex(std::string_view name) const{
+        for (int i = 0; i < numVariables; ++i){
+            if (variableNames[i] == name)
+                return i;
+        }
+        return -1;
+    }
+
+    //Interprets the tree, for expressions that are not stored in a static constexpr variable
+    template<typename Number>
+    constexpr Number evaluate(const Number* variables, int node = -1) const{
+        const CompiledNode& current = nodes[node < 0? root : node];
+        switch (current.operation){
+            case CompiledOperation::Number: return compiledNumber<Number>(current);
+            case CompiledOperation::Pi: return Number(3.14159265358979323846264338327950288L);
+            case CompiledOperation::Variable: return variables[current.variable];
+            case CompiledOperation::Ternary:
+            case CompiledOperation::Choice:
+            {
+                // both branches are evaluated in order, as at runtime, so an error in either is thrown whichever is chosen
+                Number condition = evaluate(variables, current.arguments[0]);
+                Number a = evaluate(variables, current.arguments[1]);
+                Number b = evaluate(variables, current.arguments[2]);
+                return condition == 0? b : a;
+            }
+            default:
+            {
+                // the left operand first, as at runtime, so that of two errors the same one is thrown
+                Number a = evaluate(variables, current.arguments[0]);
+                Number b = current.numArguments > 1? evaluate(variables, current.arguments[1]) : Number(0);
+                return applyCompiledOperation(current.operation, a, b);
+            }
+        }
+    }
+};
+
+//Compiles a string literal, in a constant expression when the result is declared constexpr
+template<size_t Length>
+constexpr CompiledExpression<Length> compileExpression(const char (&text)[Length]){
+    return CompiledExpression<Length>(std::string_view(text, Length-1));
+}
+
+//Expands one node of a static constexpr expression, every branch on the tree is resolved at compile time
+template<const auto& Expression, int Node, typename Number>
+inline Number evaluateCompiledNode(const Number* variables){
+    constexpr CompiledNode node = Expression.nodes[Node];
+    if constexpr (node.operation == CompiledOperation::Number && isExactDecimal<Number>(node)){
+        constexpr Number value = decimalValue<Number>(node.mantissa, node.exponent);
+        return value;
+    }
+    else if constexpr (node.operation == CompiledOperation::Number){
+        static const Number value = parseNumber<Number>(std::string(node.text));
+        return value;
+    }
+    else if constexpr (node.operation == CompiledOperation::Pi)
+        return Number(3.14159265358979323846264338327950288L);
+    else if constexpr (node.operation == CompiledOperation::Variable)
+        return variables[node.variable];
+    else if constexpr (node.operation == CompiledOperation::Ternary || node.operation == CompiledOperation::Choice){
+        Number condition = evaluateCompiledNode<Expression, node.arguments[0]>(variables);
+        Number a = evaluateCompiledNode<Expression, node.arguments[1]>(variables);
+        Number b = evaluateCompiledNode<Expression, node.arguments[2]>(variables);
+        return condition == 0? b : a;
+    }
+    else if constexpr (node.numArguments == 1)
+        return applyCompiledOperation(node.operation, evaluateCompiledNode<Expression, node.arguments[0]>(variables), Number(0));
+    else{
+        Number a = evaluateCompiledNode<Expression, node.arguments[0]>(variables);
+        Number b = evaluateCompiledNode<Expression, node.arguments[1]>(variables);
+        return applyCompiledOperation(node.operation, a, b);
+    }
+}
+
+//Evaluates a static constexpr compiled expression with its variables in order of first appearance, the type of the first one is the
+//type the expression is evaluated in, so it must be a floating point value (2.0 rather than 2)
+template<const auto& Expression, typename Number, typename... Numbers>
+inline Number evaluateCompiled(Number first, Numbers... rest){
+    static_assert(std::is_floating_point_v<Number>, "Compiled expressions are evaluated in a floating point type, pass 2.0 rather than 2");
+    static_assert(1+sizeof...(Numbers) == Expression.numVariables, "Wrong number of variables passed to compiled expression");
+    const Number variables[] = {first, Number(rest)...};
+    return evaluateCompiledNode<Expression, Expression.root>(variables);
+}
+
+template<const auto& Expression, typename Number = double>
+inline Number evaluateCompiled(){
+    static_assert(std::is_floating_point_v<Number>, "Compiled expressions are evaluated in a floating point type");
+    static_assert(Expression.numVariables == 0, "Wrong number of variables passed to compiled expression");
+    return evaluateCompiledNode<Expression, Expression.root, Number>(nullptr);
+}
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <optional>
@@ -6,25 +9,90 @@
 #include <utility>
 #include <vector>
 #include <stack>
+#include <string>
 #include <map>
 #include <exception>
+#include <thread>
 
 #include "calculator.hpp"
+#include "columns.hpp"
+#include "taskpool.hpp"
 #include "tests.hpp"
+#include "benchmarks.hpp"
 
-int main(int argc, char** argv){
-    runAllTests();
-    if (argc == 2){
+//Streams an expression over the rows of a data file, as --columns expression data.csv or --columns expression name=path ...
+//for binary columns, the results go to standard output unless a last argument --output=path names a file, errors to standard error.
+//Rows are split across threads workers, or every core when threads is 0
+template<typename Number>
+void runColumns(std::vector<std::string> arguments, unsigned threads){
+    std::ofstream file;
+    if (arguments.back().rfind("--output=", 0) == 0){
+        file.open(arguments.back().substr(9), std::ios::binary);
+        if (!file)
+            throw Error{std::string("[Error]: File '")+arguments.back().substr(9)+"' could not be created"};
+        arguments.pop_back();
+    }
+    std::ostream& output = file.is_open()? file : std::cout;
+    if (arguments.size() < 3)
+        throw Error{"[Error]: Expected --columns expression data.csv, or --columns expression name=path ... for binary columns"};
+    StreamOptions options;
+    options.threads = threads > 0? threads : std::max(1u, std::thread::hardware_concurrency());
+    if (arguments.size() == 3 && arguments[2].find('=') == std::string::npos)
+        evaluateCsv<Number>(arguments[1], arguments[2], output, options);
+    else{
+        std::map<std::string, std::string> columnPaths;
+        for (size_t i = 2; i < arguments.size(); ++i){
+            size_t separator = arguments[i].find('=');
+            if (separator == std::string::npos || separator == 0)
+                throw Error{std::string("[Error]: Expected column argument as name=path: ")+arguments[i]};
+            columnPaths[arguments[i].substr(0, separator)] = arguments[i].substr(separator+1);
+        }
+        evaluateBinaryColumns<Number>(arguments[1], columnPaths, output, options);
+    }
+    output.flush();
+}
+
+//Evaluates a file, or reads expressions line by line when arguments is empty, with every value held as a Number. Returns the exit status.
+//threads is the --threads count, 0 when it was not given
+template<typename Number>
+int runCalculator(const std::vector<std::string>& arguments, unsigned threads){
+    if (!arguments.empty() && arguments[0] == "--columns"){
+        try{
+            runColumns<Number>(arguments, threads);
+        }
+        catch (const std::exception& err){
+            std::cerr << err.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    // files and the line-by-line mode run serially unless --threads asks for more, loops and long expressions then share the pool
+    TaskPool pool(std::max(1u, threads));
+    EvaluationOptions options;
+    options.loopThreads = pool.size();
+    options.expressionPool = &pool;
+    if (!arguments.empty()){
         std::cout << "Evaluating File:\n";
         try{
-            evaluateFile(argv[1]);
+            // arguments after the file path load arrays, as name=path
+            std::map<std::string, BasicArray<Number>> arrays;
+            for (size_t i = 1; i < arguments.size(); ++i){
+                const std::string& argument = arguments[i];
+                size_t separator = argument.find('=');
+                if (separator == std::string::npos || separator == 0)
+                    throw Error{std::string("[Error]: Expected array argument as name=path: ")+argument};
+                arrays[argument.substr(0, separator)] = loadArray<Number>(argument.substr(separator+1));
+            }
+            evaluateFile(arguments[0], arrays, options);
         }
         catch (const std::exception& err){
             std::cout << err.what() << "\n";
+            return 1;
         }
     }
-    else if (argc == 1){
-        std::map<std::string, double> variables;
+    else{
+        std::map<std::string, Number> variables;
+        std::map<std::string, BasicArray<Number>> arrays;
         std::map<std::string, Function> functions;
         std::cout << "Evaluating Line-by-Line: Please input your expressions\n";
         std::string line = " ";
@@ -33,7 +101,7 @@ int main(int argc, char** argv){
                 std::cout << "> " << std::flush;
                 getline(std::cin, line);
                 if (!line.empty()){
-                    double result = evaluateExpression(line, variables, functions);
+                    BasicValue<Number> result = evaluateExpression(line, variables, arrays, functions, options);
                     if (std::find(line.begin(), line.end(), '=') == line.end() && std::find(line.begin(), line.end(), ':') == line.end())
                         std::cout << result << "\n";
                 }
@@ -43,7 +111,52 @@ int main(int argc, char** argv){
             }
         }
     }
-    else
-        throw Error{"[Error]: Too many command line arguments"};
     return 0;
 }
+
+const unsigned long maxThreads = 1024;
+
+//The N of --threads=N, 0 when it is not a count from 1 to maxThreads
+unsigned parseThreadCount(const std::string& text){
+    char* end = nullptr;
+    unsigned long count = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || !std::isdigit((unsigned char)text[0]) || *end != '\0' || count > maxThreads)
+        return 0;
+    return (unsigned)count;
+}
+
+int main(int argc, char** argv){
+    std::vector<std::string> arguments(argv+1, argv+argc);
+    // --type= and --threads= come before the mode
+    size_t mode = 0;
+    while (mode < arguments.size() && (arguments[mode].rfind("--type=", 0) == 0 || arguments[mode].rfind("--threads=", 0) == 0))
+        ++mode;
+    // with --columns standard output carries nothing but the results
+    bool streaming = arguments.size() > mode && arguments[mode] == "--columns";
+    runAllTests(streaming? std::cerr : std::cout);
+    if (arguments.size() == 1 && arguments[0] == "--benchmark"){
+        runAllBenchmarks();
+        return 0;
+    }
+    // --type=float|double|long-double selects the scalar type every value is evaluated in,
+    // --threads=N the number of threads loops, long expressions and --columns rows are split across
+    std::string type = "double";
+    unsigned threads = 0;
+    for (size_t i = 0; i < mode; ++i){
+        if (arguments[i].rfind("--type=", 0) == 0)
+            type = arguments[i].substr(7);
+        else if ((threads = parseThreadCount(arguments[i].substr(10))) == 0){
+            std::cerr << "[Error]: Expected --threads=N with N from 1 to " << maxThreads << "\n";
+            return 1;
+        }
+    }
+    arguments.erase(arguments.begin(), arguments.begin()+mode);
+    if (type == "float")
+        return runCalculator<float>(arguments, threads);
+    else if (type == "double")
+        return runCalculator<double>(arguments, threads);
+    else if (type == "long-double")
+        return runCalculator<long double>(arguments, threads);
+    std::cerr << "[Error]: Unknown number type '" << type << "', expected float, double or long-double\n";
+    return 1;
+}
@@ -0,0 +1,179 @@
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include "numeric.hpp"
+
+//double(n!) for n = 0 ... maxTableFactorial, each entry correctly rounded
+const double factorialTable[maxTableFactorial+1]{
+    1.0, 1.0, 2.0, 6.0, 24.0, 120.0,
+    720.0, 5040.0, 40320.0, 362880.0, 3628800.0, 39916800.0,
+    479001600.0, 6227020800.0, 87178291200.0, 1307674368000.0, 20922789888000.0, 355687428096000.0,
+    6402373705728000.0, 1.21645100408832e+17, 2.43290200817664e+18, 5.109094217170944e+19, 1.1240007277776077e+21, 2.585201673888498e+22,
+    6.204484017332394e+23, 1.5511210043330986e+25, 4.0329146112660565e+26, 1.0888869450418352e+28, 3.0488834461171387e+29, 8.841761993739702e+30,
+    2.6525285981219107e+32, 8.222838654177922e+33, 2.631308369336935e+35, 8.683317618811886e+36, 2.9523279903960416e+38, 1.0333147966386145e+40,
+    3.7199332678990125e+41, 1.3763753091226346e+43, 5.230226174666011e+44, 2.0397882081197444e+46, 8.159152832478977e+47, 3.345252661316381e+49,
+    1.40500611775288e+51, 6.041526306337383e+52, 2.658271574788449e+54, 1.1962222086548019e+56, 5.502622159812089e+57, 2.5862324151116818e+59,
+    1.2413915592536073e+61, 6.082818640342675e+62, 3.0414093201713376e+64, 1.5511187532873822e+66, 8.065817517094388e+67, 4.2748832840600255e+69,
+    2.308436973392414e+71, 1.2696403353658276e+73, 7.109985878048635e+74, 4.0526919504877214e+76, 2.3505613312828785e+78, 1.3868311854568984e+80,
+    8.32098711274139e+81, 5.075802138772248e+83, 3.146997326038794e+85, 1.98260831540444e+87, 1.2688693218588417e+89, 8.247650592082472e+90,
+    5.443449390774431e+92, 3.647111091818868e+94, 2.4800355424368305e+96, 1.711224524281413e+98, 1.1978571669969892e+100, 8.504785885678623e+101,
+    6.1234458376886085e+103, 4.4701154615126844e+105, 3.307885441519386e+107, 2.48091408113954e+109, 1.8854947016660504e+111, 1.4518309202828587e+113,
+    1.1324281178206297e+115, 8.946182130782976e+116, 7.156945704626381e+118, 5.797126020747368e+120, 4.753643337012842e+122, 3.945523969720659e+124,
+    3.314240134565353e+126, 2.81710411438055e+128, 2.4227095383672734e+130, 2.107757298379528e+132, 1.8548264225739844e+134, 1.650795516090846e+136,
+    1.4857159644817615e+138, 1.352001527678403e+140, 1.2438414054641308e+142, 1.1567725070816416e+144, 1.087366156656743e+146, 1.032997848823906e+148,
+    9.916779348709496e+149, 9.619275968248212e+151, 9.426890448883248e+153, 9.332621544394415e+155, 9.332621544394415e+157, 9.42594775983836e+159,
+    9.614466715035127e+161, 9.90290071648618e+163, 1.0299016745145628e+166, 1.081396758240291e+168, 1.1462805637347084e+170, 1.226520203196138e+172,
+    1.324641819451829e+174, 1.4438595832024937e+176, 1.588245541522743e+178, 1.7629525510902446e+180, 1.974506857221074e+182, 2.2311927486598138e+184,
+    2.5435597334721877e+186, 2.925093693493016e+188, 3.393108684451898e+190, 3.969937160808721e+192, 4.684525849754291e+194, 5.574585761207606e+196,
+    6.689502913449127e+198, 8.094298525273444e+200, 9.875044200833601e+202, 1.214630436702533e+205, 1.506141741511141e+207, 1.882677176888926e+209,
+    2.372173242880047e+211, 3.0126600184576594e+213, 3.856204823625804e+215, 4.974504222477287e+217, 6.466855489220474e+219, 8.47158069087882e+221,
+    1.1182486511960043e+224, 1.4872707060906857e+226, 1.9929427461615188e+228, 2.6904727073180504e+230, 3.659042881952549e+232, 5.012888748274992e+234,
+    6.917786472619489e+236, 9.615723196941089e+238, 1.3462012475717526e+241, 1.898143759076171e+243, 2.695364137888163e+245, 3.854370717180073e+247,
+    5.5502938327393044e+249, 8.047926057471992e+251, 1.1749972043909107e+254, 1.727245890454639e+256, 2.5563239178728654e+258, 3.80892263763057e+260,
+    5.713383956445855e+262, 8.62720977423324e+264, 1.3113358856834524e+267, 2.0063439050956823e+269, 3.0897696138473508e+271, 4.789142901463394e+273,
+    7.471062926282894e+275, 1.1729568794264145e+278, 1.853271869493735e+280, 2.9467022724950384e+282, 4.7147236359920616e+284, 7.590705053947219e+286,
+    1.2296942187394494e+289, 2.0044015765453026e+291, 3.287218585534296e+293, 5.423910666131589e+295, 9.003691705778438e+297, 1.503616514864999e+300,
+    2.5260757449731984e+302, 4.269068009004705e+304, 7.257415615307999e+306,
+};
+
+//long double(n!) for n = 0 ... maxTableFactorial, each entry correctly rounded to a 64 bit mantissa
+const long double longFactorialTable[maxTableFactorial+1]{
+    1.0L, 1.0L, 2.0L, 6.0L,
+    24.0L, 120.0L, 720.0L, 5040.0L,
+    40320.0L, 362880.0L, 3628800.0L, 39916800.0L,
+    479001600.0L, 6227020800.0L, 87178291200.0L, 1307674368000.0L,
+    20922789888000.0L, 355687428096000.0L, 6402373705728000.0L, 121645100408832000.0L,
+    2432902008176640000.0L, 51090942171709440000.0L, 1124000727777607680000.0L, 25852016738884976640000.0L,
+    620448401733239439360000.0L, 15511210043330985984000000.0L, 4.032914611266056355840000e+26L, 1.088886945041835216076800e+28L,
+    3.048883446117138605015040e+29L, 8.841761993739701954543616e+30L, 2.652528598121910586363085e+32L, 8.222838654177922817725563e+33L,
+    2.631308369336935301672180e+35L, 8.683317618811886495518194e+36L, 2.952327990396041408476186e+38L, 1.033314796638614492966665e+40L,
+    3.719933267899012174679994e+41L, 1.376375309122634504631598e+43L, 5.230226174666011117600072e+44L, 2.039788208119744335864028e+46L,
+    8.159152832478977343456113e+47L, 3.345252661316380710817006e+49L, 1.405006117752879898543143e+51L, 6.041526306337383563735513e+52L,
+    2.658271574788448768043626e+54L, 1.196222208654801945619632e+56L, 5.502622159812088949850305e+57L, 2.586232415111681806429644e+59L,
+    1.241391559253607267086229e+61L, 6.082818640342675608722522e+62L, 3.041409320171337804361261e+64L, 1.551118753287382280224243e+66L,
+    8.065817517094387857166064e+67L, 4.274883284060025564298014e+69L, 2.308436973392413804720927e+71L, 1.269640335365827592596510e+73L,
+    7.109985878048634518540456e+74L, 4.052691950487721675568060e+76L, 2.350561331282878571829475e+78L, 1.386831185456898357379390e+80L,
+    8.320987112741390144276341e+81L, 5.075802138772247988008568e+83L, 3.146997326038793752565312e+85L, 1.982608315404440064116147e+87L,
+    1.268869321858841641034334e+89L, 8.247650592082470666723170e+90L, 5.443449390774430640037292e+92L, 3.647111091818868528824986e+94L,
+    2.480035542436830599600990e+96L, 1.711224524281413113724683e+98L, 1.197857166996989179607278e+100L, 8.504785885678623175211676e+101L,
+    6.123445837688608686152407e+103L, 4.470115461512684340891257e+105L, 3.307885441519386412259530e+107L, 2.480914081139539809194648e+109L,
+    1.885494701666050254987932e+111L, 1.451830920282858696340708e+113L, 1.132428117820629783145752e+115L, 8.946182130782975286851442e+116L,
+    7.156945704626380229481153e+118L, 5.797126020747367985879734e+120L, 4.753643337012841748421382e+122L, 3.945523969720658651189747e+124L,
+    3.314240134565353266999388e+126L, 2.817104114380550276949479e+128L, 2.422709538367273238176552e+130L, 2.107757298379527717213601e+132L,
+    1.854826422573984391147968e+134L, 1.650795516090846108121692e+136L, 1.485715964481761497309523e+138L, 1.352001527678402962551666e+140L,
+    1.243841405464130725547532e+142L, 1.156772507081641574759205e+144L, 1.087366156656743080273653e+146L, 1.032997848823905926259970e+148L,
+    9.916779348709496892095714e+149L, 9.619275968248211985332843e+151L, 9.426890448883247745626186e+153L, 9.332621544394415268169924e+155L,
+    9.332621544394415268169924e+157L, 9.425947759838359420851623e+159L, 9.614466715035126609268656e+161L, 9.902900716486180407546715e+163L,
+    1.029901674514562762384858e+166L, 1.081396758240290900504101e+168L, 1.146280563734708354534347e+170L, 1.226520203196137939351752e+172L,
+    1.324641819451828974499892e+174L, 1.443859583202493582204882e+176L, 1.588245541522742940425370e+178L, 1.762952551090244663872161e+180L,
+    1.974506857221074023536820e+182L, 2.231192748659813646596607e+184L, 2.543559733472187557120132e+186L, 2.925093693493015690688152e+188L,
+    3.393108684451898201198256e+190L, 3.969937160808720895401960e+192L, 4.684525849754290656574312e+194L, 5.574585761207605881323432e+196L,
+    6.689502913449127057588118e+198L, 8.094298525273443739681623e+200L, 9.875044200833601362411580e+202L, 1.214630436702532967576624e+205L,
+    1.506141741511140879795014e+207L, 1.882677176888926099743768e+209L, 2.372173242880046885677147e+211L, 3.012660018457659544809977e+213L,
+    3.856204823625804217356771e+215L, 4.974504222477287440390234e+217L, 6.466855489220473672507304e+219L, 8.471580690878820510984569e+221L,
+    1.118248651196004307449963e+224L, 1.487270706090685728908451e+226L, 1.992942746161518876737324e+228L, 2.690472707318050483595388e+230L,
+    3.659042881952548657689727e+232L, 5.012888748274991661034926e+234L, 6.917786472619488492228198e+236L, 9.615723196941089004197196e+238L,
+    1.346201247571752460587607e+241L, 1.898143759076170969428526e+243L, 2.695364137888162776588508e+245L, 3.854370717180072770521566e+247L,
+    5.550293832739304789551055e+249L, 8.047926057471991944849029e+251L, 1.174997204390910823947958e+254L, 1.727245890454638911203499e+256L,
+    2.556323917872865588581178e+258L, 3.808922637630569726985955e+260L, 5.713383956445854590478933e+262L, 8.627209774233240431623189e+264L,
+    1.311335885683452545606725e+267L, 2.006343905095682394778289e+269L, 3.089769613847350887958565e+271L, 4.789142901463393876335775e+273L,
+    7.471062926282894447083809e+275L, 1.172956879426414428192158e+278L, 1.853271869493734796543610e+280L, 2.946702272495038326504340e+282L,
+    4.714723635992061322406943e+284L, 7.590705053947218729075179e+286L, 1.229694218739449434110179e+289L, 2.004401576545302577599592e+291L,
+    3.287218585534296227263330e+293L, 5.423910666131588774984495e+295L, 9.003691705778437366474262e+297L, 1.503616514864999040201202e+300L,
+    2.526075744973198387538019e+302L, 4.269068009004705274939252e+304L, 7.257415615307998967396728e+306L,
+};
+
+template<typename Number>
+Number tableEntry(int n){
+    if constexpr (std::is_same<Number, long double>::value)
+        return longFactorialTable[n];
+    else
+        return Number(factorialTable[n]);
+}
+
+template<typename Number>
+Number tableFactorial(Number n){
+    if (n > maxTableFactorial)
+        return std::exp(std::lgamma(n+1));
+    return tableEntry<Number>((int)n);
+}
+
+template<typename Number>
+Number logFactorial(Number n){
+    if (n > maxTableFactorial)
+        return std::lgamma(n+1);
+    // float overflows from 35! on, so take the log of the double entry
+    if constexpr (std::is_same<Number, float>::value)
+        return Number(std::log(factorialTable[(int)n]));
+    else
+        return std::log(tableEntry<Number>((int)n));
+}
+
+template<typename Number>
+Number binomial(Number n, Number k){
+    // the factorials behind a float binomial overflow long before the binomial does, so compute it in double and round once
+    if constexpr (std::is_same<Number, float>::value)
+        return Number(binomial(double(n), double(k)));
+    if (k > n)
+        return 0;
+    k = std::fmin(k, n-k);
+    Number result;
+    if (n <= maxTableFactorial)
+        result = tableEntry<Number>((int)n)/tableEntry<Number>((int)k)/tableEntry<Number>((int)(n-k));
+    else if (k <= maxMultiplicativeChoose){
+        // every partial result is itself a binomial coefficient, but result*(n-k+i) can overflow before the division
+        // brings it back, so then divide first; results that large are not exact integers anyway
+        result = 1;
+        for (Number i = 1; i <= k; ++i){
+            Number factor = n-k+i;
+            result = result > std::numeric_limits<Number>::max()/factor? result/i*factor : result*factor/i;
+        }
+    }
+    else
+        result = std::exp(logFactorial(n)-logFactorial(k)-logFactorial(n-k));
+    // below 2^digits every integer is representable, so the exact result is the nearest one
+    return result < std::ldexp(Number(1), std::numeric_limits<Number>::digits)? std::round(result) : result;
+}
+
+template<typename Number>
+Number integerPow(Number x, long long n){
+    if (n < 0)
+        return 1/integerPow(x, -n);
+    Number result = 1;
+    while (n > 0){
+        if (n & 1)
+            result *= x;
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+template<typename Number>
+Number fastPow(Number x, Number y){
+    if (std::fabs(y) > maxFastPowExponent)
+        return std::pow(x, y);
+    Number result;
+    if (y == std::floor(y))
+        result = integerPow(x, (long long)y);
+    else if (y*2 == std::floor(y*2) && x > 0)
+        result = integerPow(x, (long long)std::floor(y))*std::sqrt(x);
+    else
+        return std::pow(x, y);
+    // 1/x^n loses the result when x^n overflows or underflows, leave those to std::pow
+    if (result == 0 || std::isinf(result))
+        return std::pow(x, y);
+    return result;
+}
+
+#define INSTANTIATE_NUMERIC(Number) \
+    template Number tableFactorial(Number n); \
+    template Number logFactorial(Number n); \
+    template Number binomial(Number n, Number k); \
+    template Number integerPow(Number x, long long n); \
+    template Number fastPow(Number x, Number y);
+
+INSTANTIATE_NUMERIC(float)
+INSTANTIATE_NUMERIC(double)
+INSTANTIATE_NUMERIC(long double)
@@ -0,0 +1,36 @@
+#pragma once
+
+//Numeric kernels behind the builtins, templates over the scalar type instantiated for float, double and long double
+
+//Largest n whose factorial is tabulated, the largest that fits in a double
+const int maxTableFactorial = 170;
+
+//n! for a non negative integer n, read from a correctly rounded table (float rounds the double entry, within 1 ulp),
+//lgamma above maxTableFactorial, which only long double can hold (relative error about n*log(n)*2^-64), infinity once it overflows
+template<typename Number>
+Number tableFactorial(Number n);
+
+//log(n!) for a non negative integer n, exact to rounding from the table up to maxTableFactorial, lgamma(n+1) above it (a few ulp)
+template<typename Number>
+Number logFactorial(Number n);
+
+//n choose k for non negative integers, 0 when k > n, finite whenever the result fits in Number (float is computed in double and rounded once)
+//  n <= maxTableFactorial: two divisions of table entries, within 3 ulp and rounded to the exact integer when Number holds it
+//  k <= maxMultiplicativeChoose: multiplicative product, within 2k ulp
+//  otherwise: exp of the difference of log factorials, relative error about n*log(n) ulp
+template<typename Number>
+Number binomial(Number n, Number k);
+
+const int maxMultiplicativeChoose = 256;
+
+//x^n by repeated squaring, at most 2*log2(|n|) roundings
+template<typename Number>
+Number integerPow(Number x, long long n);
+
+//x^y with fast paths for integer exponents and positive bases with half integer exponents (x^n*sqrt(x)) up to maxFastPowExponent,
+//std::pow otherwise and wherever the fast path would overflow or underflow. Every squaring doubles the relative error of the product
+//so far, so the fast paths are only within |y|+2 ulp (about 0.8*|y|+2 measured), which is why maxFastPowExponent is kept small
+template<typename Number>
+Number fastPow(Number x, Number y);
+
+const int maxFastPowExponent = 16;
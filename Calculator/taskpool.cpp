@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "taskpool.hpp"
+
+TaskPool::TaskPool(unsigned numThreads){
+    numThreads = std::max(1u, numThreads);
+    for (unsigned i = 0; i < numThreads; ++i)
+        queues.push_back(std::make_unique<Queue>());
+    threadIds.push_back(std::this_thread::get_id());
+    for (unsigned i = 1; i < numThreads; ++i){
+        threads.emplace_back([this, i](){ workerLoop(i); });
+        threadIds.push_back(threads.back().get_id());
+    }
+}
+
+TaskPool::~TaskPool(){
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+unsigned TaskPool::size() const{
+    return (unsigned)queues.size();
+}
+
+//Threads outside the pool share the queue of the thread that created it
+size_t TaskPool::queueIndex() const{
+    std::thread::id id = std::this_thread::get_id();
+    for (size_t i = 0; i < threadIds.size(); ++i){
+        if (threadIds[i] == id)
+            return i;
+    }
+    return 0;
+}
+
+//Runs the newest task of the thread's own queue, or else steals the oldest task of another queue
+bool TaskPool::runOneTask(size_t queue){
+    Task task{nullptr, nullptr, 0};
+    for (size_t i = 0; i < queues.size() && !task.work; ++i){
+        Queue& victim = *queues[(queue+i)%queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        if (i == 0){
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+        }
+        else{
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task.work)
+        return false;
+    --queuedTasks;
+    Batch& batch = *task.batch;
+    if (!batch.failed){
+        try{
+            (*task.work)();
+        }
+        catch (...){
+            batch.errors[task.index] = std::current_exception();
+            batch.failed = true;
+        }
+    }
+    if (batch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        // the caller of run may be asleep waiting for its batch, the batch itself may be gone once remaining is 0
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wakeUp.notify_all();
+    }
+    return true;
+}
+
+void TaskPool::workerLoop(size_t queue){
+    while (true){
+        if (runOneTask(queue))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this](){ return stopping || queuedTasks > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+void TaskPool::run(const std::vector<std::function<void()>>& tasks){
+    if (tasks.empty())
+        return;
+    Batch batch(tasks.size());
+    size_t queue = queueIndex();
+    {
+        std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+        for (size_t i = 0; i < tasks.size(); ++i)
+            queues[queue]->tasks.push_back(Task{&tasks[i], &batch, i});
+    }
+    queuedTasks += tasks.size();
+    {
+        // taking the lock orders the new tasks before any worker that is about to sleep checks for them
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeUp.notify_all();
+    while (batch.remaining.load(std::memory_order_acquire) > 0){
+        if (runOneTask(queue))
+            continue;
+        // the rest of the batch is running on other threads, sleep until it finishes or there is a task to take
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [&](){ return batch.remaining.load(std::memory_order_acquire) == 0 || queuedTasks > 0; });
+    }
+    for (const std::exception_ptr& error : batch.errors){
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A fixed set of threads that run batches of tasks. Every thread keeps its own queue and an idle thread steals the oldest
+//task of another, so a task that starts a batch of its own, and waits for it, keeps every thread busy instead of blocking.
+//A pool is meant to be kept and reused, threads outside it may run batches too and share the queue of the thread that created it
+class TaskPool{
+public:
+    //numThreads counts the thread that created the pool, a pool of one thread runs every task on its caller
+    explicit TaskPool(unsigned numThreads);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    //Runs every task and returns once all of them have finished, the calling thread runs tasks while it waits and sleeps once none is left to take.
+    //Once a task throws the tasks of the batch that have not started are skipped, and the exception of the first task in order is rethrown
+    void run(const std::vector<std::function<void()>>& tasks);
+
+    unsigned size() const;
+
+private:
+    struct Batch{
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed{false};
+        std::vector<std::exception_ptr> errors;
+
+        Batch(size_t numTasks) : remaining(numTasks), errors(numTasks){}
+    };
+
+    struct Task{
+        const std::function<void()>* work;
+        Batch* batch;
+        size_t index;
+    };
+
+    struct Queue{
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::vector<std::thread::id> threadIds;
+    std::atomic<long long> queuedTasks{0};
+    bool stopping = false;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    size_t queueIndex() const;
+    bool runOneTask(size_t queue);
+    void workerLoop(size_t queue);
+};
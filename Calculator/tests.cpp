@@ -1,7 +1,17 @@
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <iostream>
+#include <thread>
 
 #include "tests.hpp"
 #include "calculator.hpp"
+#include "numeric.hpp"
+#include "compiled.hpp"
+#include "columns.hpp"
+#include "taskpool.hpp"
 
 void test_tokenize(const std::string& str){
     std::vector<Token> tokens = tokenize(str);
@@ -121,14 +131,397 @@ void test_varsAndFuncs(){
                 1.0);
 }
 
+void test_arrays(){
+    std::map<std::string, double> variables;
+    std::map<std::string, Array> arrays;
+    std::map<std::string, Function> functions;
+    expect_eq(convertPostfix_to_strings("[1, 2+3] * 2"),
+              std::vector<std::string>{"1", "2", "3", "+", "[]", "2", "*"});
+    evaluateExpression("xs = [1, 2, 3, 4, 5]", variables, arrays, functions);
+    evaluateExpression("ys = [2, -1, 0, 1, 3]", variables, arrays, functions);
+    evaluateExpression("scale(v, k) = v*k", variables, arrays, functions);
+    expect_eq(evaluateExpression("xs*2 + 1", variables, arrays, functions).array,
+              Array{3, 5, 7, 9, 11});
+    expect_eq(evaluateExpression("xs - ys", variables, arrays, functions).array,
+              Array{-1, 3, 3, 3, 2});
+    expect_eq(evaluateExpression("xs > 2 ? xs : 0-xs", variables, arrays, functions).array,
+              Array{-1, -2, 3, 4, 5});
+    expect_eq(evaluateExpression("max(xs, 3)", variables, arrays, functions).array,
+              Array{3, 3, 3, 4, 5});
+    expect_eq(evaluateExpression("scale(xs, 10)", variables, arrays, functions).array,
+              Array{10, 20, 30, 40, 50});
+    expect_eq(evaluateExpression("[xs, 6]", variables, arrays, functions).array,
+              Array{1, 2, 3, 4, 5, 6});
+    expect_eq(evaluateExpression("[1+2, 3]", variables, arrays, functions).array,
+              Array{3, 3});
+    expect_near(evaluateExpression("sum(xs)", variables, arrays, functions).scalar,
+                15.0);
+    expect_near(evaluateExpression("mean(xs)", variables, arrays, functions).scalar,
+                3.0);
+    expect_near(evaluateExpression("dot(xs, ys)", variables, arrays, functions).scalar,
+                19.0);
+    expect_near(evaluateExpression("min(ys) + max(ys)", variables, arrays, functions).scalar,
+                2.0);
+    expect_near(evaluateExpression("sum(sqrt(xs*xs))", variables, arrays, functions).scalar,
+                15.0);
+    // NaNs are skipped by min and max, as with fmin and fmax
+    evaluateExpression("gaps = [sqrt(0-1), 4, 9, sqrt(0-1), 2, 7, 3, 8, 6, 5, 1]", variables, arrays, functions);
+    expect_near(evaluateExpression("min(gaps) + max(gaps)", variables, arrays, functions).scalar,
+                10.0);
+    expect_eq(std::isnan(evaluateExpression("min([sqrt(0-1), sqrt(0-1)])", variables, arrays, functions).scalar),
+              true);
+    expect_near(evaluateExpression("min(1, 2)", variables, arrays, functions).scalar,
+                1.0);
+    expect_throw([&](){ evaluateExpression("xs + [1, 2]", variables, arrays, functions); },
+                 "[Error]: Array size mismatch (5 vs 2)");
+    expect_throw([&](){ evaluateExpression("choice(1, 2)", variables, arrays, functions); },
+                 "[Error]: Incorrect number of arguments passed to function 'choice'");
+    // the scalar overload rejects an array assignment without losing the old value
+    std::map<std::string, double> scalars;
+    evaluateExpression("a = 5", scalars, functions);
+    expect_throw([&](){ evaluateExpression("a = [1, 2]", scalars, functions); },
+                 "[Error]: Array variables require an array table");
+    expect_near(evaluateExpression("a", scalars, functions), 5.0);
+}
+
+void test_loops(){
+    std::map<std::string, double> variables;
+    std::map<std::string, Array> arrays;
+    std::map<std::string, Function> functions;
+    expect_eq(convertPostfix_to_strings("1 + sum(i, 1, n, i^2)"),
+              std::vector<std::string>{"1", "1", "n", "sum", "+"});
+    evaluateExpression("n = 10", variables, arrays, functions);
+    evaluateExpression("square(x) = x*x", variables, arrays, functions);
+    expect_near(evaluateExpression("sum(i, 1, 100, i)", variables, arrays, functions).scalar,
+                5050.0);
+    expect_near(evaluateExpression("prod(i, 1, 5, i)", variables, arrays, functions).scalar,
+                120.0);
+    expect_near(evaluateExpression("sum(i, 1, n, square(i))", variables, arrays, functions).scalar,
+                385.0);
+    expect_near(evaluateExpression("sum(i, 1, 3, sum(j, 1, i, j))", variables, arrays, functions).scalar,
+                10.0);
+    expect_near(evaluateExpression("sum(i, 5, 1, i) + prod(i, 5, 1, i)", variables, arrays, functions).scalar,
+                1.0);
+    expect_eq(evaluateExpression("sum(i, 1, 3, [i, 2*i])", variables, arrays, functions).array,
+              Array{6, 12});
+    expect_throw([&](){ evaluateExpression("sum(i, 1, 2, i) + i", variables, arrays, functions); },
+                 "[Error]: Unrecognized identifier 'i'");
+    expect_throw([&](){ evaluateExpression("sum(2, 1, 2, i)", variables, arrays, functions); },
+                 "[Error]: Loop variable of 'sum' must be an identifier");
+    expect_throw([&](){ evaluateExpression("sum(i, 1, 10^300, i)", variables, arrays, functions); },
+                 "[Error]: Loop range is too long");
+    // chunked evaluation combines in the same order regardless of the number of threads
+    EvaluationOptions serial;
+    serial.loopChunkSize = 1000;
+    EvaluationOptions parallel = serial;
+    parallel.loopThreads = 4;
+    double serialResult = evaluateExpression("sum(k, 1, 100000, 1/k^2)", variables, arrays, functions, serial).scalar;
+    double parallelResult = evaluateExpression("sum(k, 1, 100000, 1/k^2)", variables, arrays, functions, parallel).scalar;
+    expect_eq(serialResult, parallelResult);
+    expect_near(parallelResult, M_PI*M_PI/6);
+    expect_throw([&](){ evaluateExpression("sum(k, 1, 5000, k == 4321 ? factorial(0.5) : k)", variables, arrays, functions, parallel); },
+                 "[Error]: Cannot calculate factorial of non integer");
+}
+
+void test_budgets(){
+    std::map<std::string, double> variables;
+    std::map<std::string, Array> arrays;
+    std::map<std::string, Function> functions;
+    expect_eq(evaluateExpression("factorial(1000000000000)", variables, functions),
+              double(INFINITY));
+    evaluateExpression("countdown(n) = n", variables, arrays, functions);
+    evaluateExpression("countdown(n) = n <= 0 ? 0 : countdown(n-1)", variables, arrays, functions);
+    expect_throw([&](){ evaluateExpression("countdown(5)", variables, arrays, functions); },
+                 "[Error]: Evaluation exceeded the call depth limit of 64");
+    // the limit must be reached before the stack of a secondary thread runs out, here on a thread of the test and on the loop's own workers
+    EvaluationOptions threaded;
+    threaded.loopThreads = 2;
+    threaded.loopChunkSize = 1;
+    std::thread worker([&](){
+        expect_throw([&](){ evaluateExpression("sum(k, 1, 2, countdown(k))", variables, arrays, functions, threaded); },
+                     "[Error]: Evaluation exceeded the call depth limit of 64");
+    });
+    worker.join();
+    EvaluationOptions stepLimited;
+    stepLimited.maxSteps = 100000;
+    expect_near(evaluateExpression("sum(i, 1, 1000, i)", variables, arrays, functions, stepLimited).scalar,
+                500500.0);
+    expect_throw([&](){ evaluateExpression("sum(i, 1, 1000000000000, i)", variables, arrays, functions, stepLimited); },
+                 "[Error]: Evaluation exceeded the step limit of 100000");
+    // adversarial inputs must stop at their deadline, even when split across threads; --benchmark reports how far past it
+    for (unsigned threads : {1u, 4u}){
+        EvaluationOptions timeLimited;
+        timeLimited.maxTime = std::chrono::milliseconds(20);
+        timeLimited.loopThreads = threads;
+        timeLimited.loopChunkSize = 1000;
+        expect_throw([&](){ evaluateExpression("sum(i, 1, 1000000000000, sum(j, 1, 10, i*j))", variables, arrays, functions, timeLimited); },
+                     "[Error]: Evaluation exceeded the time limit of 20ms");
+    }
+    CancellationToken cancellation;
+    EvaluationOptions cancellable;
+    cancellable.cancellation = &cancellation;
+    std::thread controller([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        cancellation.cancel();
+    });
+    expect_throw([&](){ evaluateExpression("sum(i, 1, 1000000000000, i)", variables, arrays, functions, cancellable); },
+                 "[Error]: Evaluation cancelled");
+    controller.join();
+}
+
+void test_numeric(){
+    std::map<std::string, double> variables;
+    std::map<std::string, Function> functions;
+    expect_eq(tableFactorial(20.0), 2432902008176640000.0);
+    expect_eq(tableFactorial(171.0), double(INFINITY));
+    expect_near(logFactorial(1000.0)/(1000*std::log(1000.0)-1000+0.5*std::log(2*M_PI*1000)+1/12000.0), 1.0);
+    expect_eq(binomial(52.0, 5.0), 2598960.0);
+    expect_eq(binomial(5.0, 7.0), 0.0);
+    expect_near(binomial(1000.0, 500.0)/2.702882409454366e299, 1.0);
+    expect_near(binomial(100000.0, 3.0)/166661666700000.0, 1.0);
+    // n*(n-1) overflows, n*(n-1)/2 does not
+    expect_near(binomial(1.5e154, 2.0)/1.125e308, 1.0);
+    expect_eq(binomial(100000.0, 50000.0), double(INFINITY));
+    expect_near(binomial(1200.0, 300.0)/3.07290024597502e291, 1.0);
+    for (double x : {0.3, 1.7, 12.5, 1000.0})
+        for (double y : {-7.0, -2.0, -1.5, 0.0, 0.5, 1.0, 2.0, 3.5, 64.0, 2.7})
+            expect_near(fastPow(x, y)/std::pow(x, y), 1.0);
+    expect_eq(fastPow(1e5, -64.0), std::pow(1e5, -64.0));
+    // the fast paths stay within |y|+2 ulp of the exact power
+    for (double x : {0.3, 0.7071, 1.7, 1.999, 12.5})
+        for (double y = -maxFastPowExponent; y <= maxFastPowExponent; y += 0.5){
+            long double exact = std::pow((long double)x, (long double)y);
+            double ulp = std::nextafter(double(exact), double(INFINITY))-double(exact);
+            expect_eq(std::fabs(fastPow(x, y)-exact) <= (std::fabs(y)+2)*ulp, true);
+        }
+    expect_near(evaluateExpression("choose(200, 3)", variables, functions),
+                1313400.0);
+    expect_near(evaluateExpression("2^10 + 4^0.5 + 4^(-1.5)", variables, functions),
+                1026.125);
+    expect_throw([&](){ evaluateExpression("choose(5.5, 2)", variables, functions); },
+                 "[Error]: Cannot calculate choose of non integer");
+}
+
+void test_numberTypes(){
+    std::map<std::string, float> floatVariables;
+    std::map<std::string, BasicArray<float>> floatArrays;
+    std::map<std::string, long double> longDoubleVariables;
+    std::map<std::string, Function> functions;
+    expect_eq(evaluateExpression("0.1 + 0.2", floatVariables, functions),
+              0.1f + 0.2f);
+    expect_eq(evaluateExpression("xs = [1, 2, 3]", floatVariables, floatArrays, functions).scalar,
+              0.0f);
+    expect_eq(evaluateExpression("xs*0.5 + 1", floatVariables, floatArrays, functions).array,
+              BasicArray<float>{1.5f, 2.0f, 2.5f});
+    expect_eq(evaluateExpression("factorial(34) < factorial(35)", floatVariables, functions),
+              1.0f);
+    expect_eq(evaluateExpression("factorial(35)", floatVariables, functions),
+              float(INFINITY));
+    // binomials whose factorials overflow a float still fit in one
+    expect_eq(evaluateExpression("choose(35, 2)", floatVariables, functions),
+              595.0f);
+    expect_eq(evaluateExpression("choose(40, 1)", floatVariables, functions),
+              40.0f);
+    expect_eq(evaluateExpression("choose(100, 50)", floatVariables, functions),
+              float(1.0089134454556419e29));
+    expect_near(logFactorial(40.0f), float(std::lgamma(41.0)));
+    // long double keeps the digits a double rounds away
+    expect_eq(evaluateExpression("0.1", longDoubleVariables, functions),
+              0.1L);
+    // as do the literals of a loop body, which are parsed once for every type
+    expect_eq(evaluateExpression("sum(i, 1, 1, 0.1)", longDoubleVariables, functions),
+              0.1L);
+    expect_eq(evaluateExpression("sum(i, 1, 2, 0.1*i)", floatVariables, functions),
+              0.1f + 0.2f);
+    expect_eq(evaluateExpression("choose(60, 30)", longDoubleVariables, functions),
+              118264581564861424.0L);
+    expect_near(std::log10(evaluateExpression("factorial(1000)", longDoubleVariables, functions))/2567.6046, 1.0L);
+}
+
+void test_parallelExpressions(){
+    std::map<std::string, double> variables{{"x", 0.37}};
+    std::map<std::string, Array> arrays;
+    std::map<std::string, Function> functions;
+    std::string sum, difference, elements;
+    for (int i = 0; i < 2000; ++i){
+        sum += (i? " + " : "")+std::string("sin(x*")+std::to_string(i%97)+")/3";
+        difference += (i? " - " : "")+std::string("x*")+std::to_string(i%7)+".5";
+        elements += (i? ", " : "")+std::to_string(i)+"*x";
+    }
+    std::vector<std::string> expressions{
+        sum,
+        difference,
+        "max("+sum+", "+difference+")",
+        "x > 0 ? "+difference+" : "+sum,
+        "sum(["+elements+"])",
+    };
+    // the pools serve every evaluation below
+    TaskPool twoThreads(2);
+    TaskPool fourThreads(4);
+    for (const std::string& expression : expressions){
+        std::vector<Token> postfix = convertToPostfix(tokenize(expression), functions);
+        double serial = evaluateExpression(postfix, variables, arrays, functions).scalar;
+        EvaluationOptions options;
+        options.expressionTaskSize = 64;
+        options.expressionPool = &twoThreads;
+        double parallel = evaluateExpression(postfix, variables, arrays, functions, options).scalar;
+        expect_near(parallel/serial, 1.0);
+        // the combining order depends only on the task size
+        options.expressionPool = &fourThreads;
+        expect_eq(evaluateExpression(postfix, variables, arrays, functions, options).scalar, parallel);
+    }
+    // only chains of one associative operator are regrouped, a chain of - is combined in the serial order
+    EvaluationOptions options;
+    options.expressionTaskSize = 64;
+    options.expressionPool = &fourThreads;
+    expect_eq(evaluateExpression(convertToPostfix(tokenize(difference), functions), variables, arrays, functions, options).scalar,
+              evaluateExpression(difference, variables, functions));
+    // threads outside the pool may run evaluations on it at the same time
+    std::vector<Token> sumPostfix = convertToPostfix(tokenize(sum), functions);
+    double sumResult = evaluateExpression(sumPostfix, variables, arrays, functions, options).scalar;
+    std::thread other([&](){
+        for (int i = 0; i < 20; ++i)
+            expect_eq(evaluateExpression(sumPostfix, variables, arrays, functions, options).scalar, sumResult);
+    });
+    for (int i = 0; i < 20; ++i)
+        expect_eq(evaluateExpression(sumPostfix, variables, arrays, functions, options).scalar, sumResult);
+    other.join();
+    expect_throw([&](){ evaluateExpression(convertToPostfix(tokenize(sum+" + (0-1)^0.5"), functions), variables, arrays, functions, options); },
+                 "[Error]: -1.000000^0.500000 is not a number");
+    options.maxSteps = 1000;
+    expect_throw([&](){ evaluateExpression(convertToPostfix(tokenize(sum), functions), variables, arrays, functions, options); },
+                 "[Error]: Evaluation exceeded the step limit of 1000");
+}
+
+static constexpr auto compiledArithmetic = compileExpression("1+2*3-8/4");
+static constexpr auto compiledCircle = compileExpression("pi*r^2");
+static constexpr auto compiledMixed = compileExpression("x < y ? max(x+1, y) : 0-x*(y-2.5) % 3");
+static constexpr auto compiledBuiltins = compileExpression("sqrt(abs(a)) + choose(n, 2) + min(1+2, 3)");
+
+void test_compiled(){
+    std::map<std::string, double> variables;
+    std::map<std::string, Function> functions;
+    static_assert(compiledArithmetic.evaluate<double>(nullptr) == 5.0);
+    static_assert(compileExpression("(1+2)^2").numVariables == 0);
+    static_assert(compiledMixed.numVariables == 2 && compiledMixed.variableIndex("y") == 1);
+    expect_eq(evaluateCompiled<compiledArithmetic>(), 5.0);
+    expect_eq(evaluateCompiled<compiledCircle>(2.0), evaluateExpression("pi*2^2", variables, functions));
+    // compiled and runtime evaluation agree on every branch, the interpreted tree with the expanded code
+    for (double x = -3; x <= 3; x += 0.5){
+        for (double y = -2; y <= 2; y += 1){
+            variables["x"] = x;
+            variables["y"] = y;
+            expect_eq(evaluateCompiled<compiledMixed>(x, y), evaluateExpression("x < y ? max(x+1, y) : 0-x*(y-2.5) % 3", variables, functions));
+            double values[] = {x, y};
+            expect_eq(compiledMixed.evaluate(values), evaluateCompiled<compiledMixed>(x, y));
+        }
+    }
+    variables["a"] = -16;
+    variables["n"] = 10;
+    expect_eq(evaluateCompiled<compiledBuiltins>(-16.0, 10.0), evaluateExpression("sqrt(abs(a)) + choose(n, 2) + min(1+2, 3)", variables, functions));
+    expect_eq(evaluateCompiled<compiledBuiltins>(-16.0f, 10.0f), 52.0f);
+    expect_eq(evaluateExpression("max(1+2, 0)", variables, functions), 3.0);
+    expect_eq(compileExpression("0.1").evaluate<float>(nullptr), 0.1f);
+    expect_eq(compileExpression("0.1").evaluate<long double>(nullptr), 0.1L);
+    // a mantissa past 2^53 would be rounded twice by mantissa/10^k, such numbers are parsed as at runtime
+    static constexpr auto compiledLongLiteral = compileExpression("91059.33494858065 + x");
+    const double zero = 0;
+    expect_eq(evaluateCompiled<compiledLongLiteral>(zero), evaluateExpression("91059.33494858065", variables, functions));
+    expect_eq(compiledLongLiteral.evaluate(&zero), evaluateExpression("91059.33494858065", variables, functions));
+    expect_eq(compileExpression("123456789012345678901234.5").evaluate<double>(nullptr), 123456789012345678901234.5);
+    expect_throw([](){ compileExpression("(1+2"); }, "[Error]: More left parentheses than right");
+    expect_throw([](){ compileExpression("f(1)"); }, "[Error]: Function is not supported in compiled expressions");
+    expect_throw([](){ compileExpression("1 # 2"); }, "[Error]: Unrecognized symbol: #");
+    expect_throw([](){ compileExpression("max(1, 2 (3))"); }, "[Error]: Operator omitted | Token #: 2");
+    expect_throw([](){ compileExpression("1, 2"); }, "[Error]: Unused operand(s)");
+    expect_throw([](){ compileExpression("min(1, 2, 3)"); }, "[Error]: Incorrect number of arguments passed to function 'min'");
+    expect_eq(compileExpression("min(4)").evaluate<double>(nullptr), evaluateExpression("min(4)", variables, functions));
+    // both branches are evaluated, so the error of the branch that is not chosen is thrown as at runtime
+    static constexpr auto compiledGuarded = compileExpression("x > 0 ? sqrt(x) : factorial(0.5)");
+    variables["x"] = 4;
+    expect_throw([&](){ evaluateExpression("x > 0 ? sqrt(x) : factorial(0.5)", variables, functions); },
+                 "[Error]: Cannot calculate factorial of non integer");
+    expect_throw([](){ evaluateCompiled<compiledGuarded>(4.0); }, "[Error]: Cannot calculate factorial of non integer");
+    expect_throw([](){ compileExpression("choice(1, 2, factorial(0-1))").evaluate<double>(nullptr); },
+                 "[Error]: Cannot calculate factorial of negative number");
+    // operands are evaluated left to right, so of two errors the first one is thrown
+    static constexpr auto compiledTwoErrors = compileExpression("factorial(0.5) + factorial(0-1)");
+    expect_throw([&](){ evaluateExpression("factorial(0.5) + factorial(0-1)", variables, functions); },
+                 "[Error]: Cannot calculate factorial of non integer");
+    expect_throw([](){ compiledTwoErrors.evaluate<double>(nullptr); }, "[Error]: Cannot calculate factorial of non integer");
+    expect_throw([](){ evaluateCompiled<compiledTwoErrors>(); }, "[Error]: Cannot calculate factorial of non integer");
+    expect_throw([](){ compileExpression("(0-8)^(1/3)").evaluate<double>(nullptr); }, "[Error]: -8.000000^0.333333 is not a number");
+    expect_throw([](){ compileExpression("[1, 2]"); }, "[Error]: Arrays are not supported in compiled expressions");
+}
+
+void test_columns(){
+    // every run writes into a directory of its own, the tests run on each start and several may run at once
+    std::string pattern = (std::filesystem::temp_directory_path()/"calculator_test_XXXXXX").string();
+    expect_eq(mkdtemp(pattern.data()) != nullptr, true);
+    std::filesystem::path directory = pattern;
+    std::string csvPath = (directory/"calculator_test_columns.csv").string();
+    std::ofstream(csvPath) << "id, x ,y,label\r\n1,0.5,2,a\r\n2, 1.5 ,+3,b\r\n\r\n3,-2,1e2,c\n4,2,4,d";
+    std::string expected = "2\n5.5\n-200\n9\n";
+    // tiny chunks and a window of two chunks exercise the ordering of the pipeline
+    StreamOptions options;
+    options.threads = 3;
+    options.chunkSize = 4;
+    options.maxChunksInFlight = 2;
+    std::ostringstream output;
+    expect_eq(evaluateCsv("x*y + (x > 0 ? 1 : 0)", csvPath, output, options), 4LL);
+    expect_eq(output.str(), expected);
+    output.str("");
+    evaluateCsv("sum(i, 1, 3, x*i)", csvPath, output);
+    expect_eq(output.str(), std::string("3\n9\n-12\n12\n"));
+    expect_throw([&](){ evaluateCsv("sum(x)", csvPath, output); },
+                 "[Error]: 'sum' combines rows and cannot be used when streaming rows");
+    // a bound may read a loop variable but not a column, whose value differs from row to row
+    output.str("");
+    evaluateCsv("sum(i, 1, 3, sum(j, 1, i, x))", csvPath, output);
+    expect_eq(output.str(), std::string("3\n9\n-12\n12\n"));
+    expect_throw([&](){ evaluateCsv("sum(i, 1, y, i)", csvPath, output); },
+                 "[Error]: Loop bounds cannot depend on column 'y' when streaming rows");
+    expect_throw([&](){ evaluateCsv("sum(i, sum(j, 1, 2, x), 5, i)", csvPath, output); },
+                 "[Error]: Loop bounds cannot depend on column 'x' when streaming rows");
+    expect_throw([&](){ evaluateCsv("label", csvPath, output); },
+                 "[Error]: Column 'label' contains a value that is not a number: a");
+    std::ofstream(csvPath) << "x,y\n1,2\n3\n";
+    expect_throw([&](){ evaluateCsv("x+y", csvPath, output, options); },
+                 "[Error]: Row has 1 fields, expected 2: 3");
+    std::string aPath = (directory/"calculator_test_a.bin").string();
+    std::string bPath = (directory/"calculator_test_b.bin").string();
+    double a[] = {1, 2, 3, 4, 5};
+    double b[] = {10, 20, 30, 40, 50};
+    std::ofstream(aPath, std::ios::binary).write(reinterpret_cast<const char*>(a), sizeof(a));
+    std::ofstream(bPath, std::ios::binary).write(reinterpret_cast<const char*>(b), sizeof(b)-sizeof(double));
+    expect_throw([&](){ evaluateBinaryColumns("a*b", {{"a", aPath}, {"b", bPath}}, output); },
+                 "[Error]: Column 'b' has 4 rows, expected 5");
+    expect_throw([&](){ evaluateBinaryColumns("prod(i, 1, a, b)", {{"a", aPath}, {"b", bPath}}, output); },
+                 "[Error]: Loop bounds cannot depend on column 'a' when streaming rows");
+    std::ofstream(bPath, std::ios::binary).write(reinterpret_cast<const char*>(b), sizeof(b));
+    output.str("");
+    options.chunkSize = 2*sizeof(double);
+    expect_eq(evaluateBinaryColumns("a*b - 1", {{"a", aPath}, {"b", bPath}}, output, options), 5LL);
+    expect_eq(output.str(), std::string("9\n39\n89\n159\n249\n"));
+    std::filesystem::remove_all(directory);
+}
+
 void test_exceptions(){
     
 }
 
-void runAllTests(){
+void runAllTests(std::ostream& log){
     test_tokenize();
     test_convertPostfix();
     test_evaluate();
     test_varsAndFuncs();
-    std::cout << "Tests Succeeded\n";
+    test_arrays();
+    test_loops();
+    test_budgets();
+    test_numeric();
+    test_numberTypes();
+    test_parallelExpressions();
+    test_compiled();
+    test_columns();
+    log << "Tests Succeeded\n";
 }
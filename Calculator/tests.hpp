@@ -1,4 +1,5 @@
 #pragma once
+#include <iostream>
 #include <string>
 #include <vector>
 #include <exception>
@@ -65,6 +66,23 @@ void test_evaluate();
 
 void test_varsAndFuncs();
 
+void test_arrays();
+
+void test_loops();
+
+void test_budgets();
+
+void test_numeric();
+
+void test_numberTypes();
+
+void test_parallelExpressions();
+
+void test_compiled();
+
+void test_columns();
+
 void test_exceptions();
 
-void runAllTests();
+//Runs every test and reports success on log
+void runAllTests(std::ostream& log = std::cout);